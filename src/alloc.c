@@ -25,8 +25,32 @@
 
 #include "common.h"
 #include "alloc.h"
+#include "util.h"
 
-static size_t alloc_limit = 0;
+static THREAD_LOCAL size_t alloc_limit = 0;
+
+/* While an arena is open, allocations up to ARENA_MAX_OBJECT bytes are
+   carved out of large chunks, and released all at once when it is
+   closed.  Freeing them individually does nothing. */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_MAX_OBJECT 1024
+#define ARENA_ALIGN 16
+
+typedef struct Arena_Chunk
+{
+    struct Arena_Chunk *next;
+    size_t size;
+    size_t used;
+} Arena_Chunk;
+
+/* the chunk header is padded so that data starts aligned */
+#define ARENA_HEADER_SIZE \
+    ((sizeof (Arena_Chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_DATA(_chunk) ((unsigned char*)(_chunk) + ARENA_HEADER_SIZE)
+
+static THREAD_LOCAL Arena_Chunk *arena = NULL;  /* current chunk first */
+static THREAD_LOCAL Arena_Chunk *arena_spare = NULL;  /* for the next arena */
+static THREAD_LOCAL int arena_open = 0;
 
 void
 set_alloc_limit (size_t size)
@@ -70,10 +94,121 @@ alloc_limit_assert (char *fn_name, size_t size)
     if (alloc_limit && size > alloc_limit)
     {
         alloc_limit_failure (fn_name, size);
-        exit (-1);
+        tnef_exit (-1);
+    }
+}
+
+void
+alloc_arena_begin (void)
+{
+    assert (!arena_open);
+    arena_open = 1;
+}
+
+void
+alloc_arena_end (void)
+{
+    assert (arena_open);
+    arena_open = 0;
+
+    /* keep one chunk around, it will most likely be needed again */
+    while (arena)
+    {
+        Arena_Chunk *next = arena->next;
+        if (arena_spare == NULL && arena->size == ARENA_CHUNK_SIZE)
+        {
+            arena_spare = arena;
+            arena_spare->next = NULL;
+        }
+        else
+        {
+            free (arena);
+        }
+        arena = next;
     }
 }
 
+/* frees the chunk alloc_arena_end kept, before the thread goes away */
+void
+alloc_arena_release (void)
+{
+    assert (!arena_open);
+    free (arena_spare);
+    arena_spare = NULL;
+}
+
+static int
+arena_owns (void *ptr)
+{
+    Arena_Chunk *c;
+
+    for (c = arena; c; c = c->next)
+    {
+        if ((unsigned char*)ptr >= ARENA_DATA(c)
+            && (unsigned char*)ptr < ARENA_DATA(c) + c->size)
+            return 1;
+    }
+    return 0;
+}
+
+/* Returns size bytes from the arena.  Chunks double in size as they are
+   added, so that arena_owns has only a few of them to look at. */
+static void*
+arena_alloc (size_t size)
+{
+    void *ptr;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (arena == NULL || arena->size - arena->used < size)
+    {
+        Arena_Chunk *c = NULL;
+        size_t chunk_size = arena ? arena->size * 2 : ARENA_CHUNK_SIZE;
+
+        if (arena == NULL && arena_spare)
+        {
+            c = arena_spare;
+            arena_spare = NULL;
+        }
+        else
+        {
+            c = malloc (ARENA_HEADER_SIZE + chunk_size);
+            if (!c)
+            {
+                perror ("xmalloc: Memory allocation failure");
+                abort();
+            }
+            c->size = chunk_size;
+        }
+        c->used = 0;
+        c->next = arena;
+        arena = c;
+    }
+
+    ptr = ARENA_DATA(arena) + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+void
+xfree (void *ptr)
+{
+    if (arena_open && arena_owns (ptr)) return;
+    free (ptr);
+}
+
+/* Gives back what is past the first size bytes of ptr, returning where
+   it now is.  Memory from the arena stays as it is. */
+void*
+xshrink (void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL || (arena_open && arena_owns (ptr))) return ptr;
+    p = realloc (ptr, size ? size : 1);
+    return p ? p : ptr;
+}
+
 /* attempts to malloc memory, if fails print error and call abort */
 void*
 xmalloc (size_t num, size_t size, size_t extra)
@@ -83,6 +218,8 @@ xmalloc (size_t num, size_t size, size_t extra)
         abort();
     if (res + extra < res)
         abort();
+    if (arena_open && res + extra <= ARENA_MAX_OBJECT)
+        return arena_alloc (res + extra);
     void *ptr = malloc (res + extra);
     if (!ptr
         && (size != 0))         /* some libc don't like size == 0 */
@@ -117,7 +254,10 @@ xcalloc (size_t num, size_t size, size_t extra)
     void *ptr;
     if (res + extra < res)
         abort();
-    ptr = malloc(res + extra);
+    if (arena_open && res + extra <= ARENA_MAX_OBJECT)
+        ptr = arena_alloc (res + extra);
+    else
+        ptr = malloc(res + extra);
     if (ptr)
     {
         memset (ptr, '\0', (res + extra));
@@ -39,6 +39,18 @@ extern void* checked_xmalloc (size_t num, size_t size, size_t extra);
 extern void* xmalloc (size_t num, size_t size, size_t extra);
 extern void* checked_xcalloc (size_t num, size_t size, size_t extra);
 extern void* xcalloc (size_t num, size_t size, size_t extra);
+extern void xfree (void *ptr);
+extern void* xshrink (void *ptr, size_t size);
+
+/* Between these, small allocations come from an arena which is freed
+   as a whole by alloc_arena_end.  Memory from the arena must not be
+   used after that, nor freed other than through XFREE. */
+extern void alloc_arena_begin (void);
+extern void alloc_arena_end (void);
+
+/* alloc_arena_end keeps a chunk for the next arena of the thread, this
+   frees it.  To be called by a thread which has parsed before it exits. */
+extern void alloc_arena_release (void);
 
 #define XMALLOC(_type,_num)			                \
   ((_type*)xmalloc((_num), sizeof(_type), 0))
@@ -53,6 +65,6 @@ extern void* xcalloc (size_t num, size_t size, size_t extra);
 #define CHECKED_XCALLOC_ADDNULL(_type,_num)		\
   ((_type*)checked_xcalloc((_num),sizeof(_type),1))
 #define XFREE(_ptr)						\
-        do { if (_ptr) { free (_ptr); _ptr = 0; } } while (0)
+        do { if (_ptr) { xfree (_ptr); _ptr = 0; } } while (0)
 
 #endif /* ALLOC_H */
@@ -0,0 +1,688 @@
+/*
+ * async.c -- write the files in the background
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       With --async-write file_write only creates each file and leaves
+ *       writing and closing it to this, so that parsing goes on while
+ *       the data is on its way to the disk.  The parse waits for its
+ *       files at the end (or when it comes to write a name which is
+ *       still being written).
+ *
+ *       On Linux the writes and closes go through an io_uring, set up
+ *       with the system calls themselves so nothing more is needed to
+ *       build.  Each file has one operation in flight at a time, the
+ *       next (the rest of a short write, the close) being queued as
+ *       the last completes.  Whichever waiting parse gets there first
+ *       reaps the completions for all of them.  Elsewhere, or where the
+ *       kernel says no, a few threads take the files off a queue and
+ *       write them as file_write would have.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include <errno.h>
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#if HAVE_PTHREAD_H && HAVE_TLS
+#  include <pthread.h>
+#  define USE_THREADS 1
+#endif
+
+#if USE_THREADS && HAVE_LINUX_IO_URING_H && HAVE_SYS_SYSCALL_H \
+    && HAVE_SYS_MMAN_H
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) \
+      && defined(__NR_io_uring_register)
+#    define USE_IO_URING 1
+#  endif
+#endif
+
+#include "alloc.h"
+#include "async.h"
+#include "output.h"
+
+#define ASYNC_THREADS 4
+#define ASYNC_RING_ENTRIES 64
+#define ASYNC_CHUNK_SIZE (1024 * 1024 * 1024) /* most one write is given */
+
+typedef struct async_job
+{
+    Async_Batch *batch;
+    char *path;
+    int fd;
+    const unsigned char *data;
+    size_t len;
+    size_t done;                /* written so far */
+    unsigned char *owned;       /* data, when it was taken over */
+    int in_file;                /* data is also at in_offset in in_fd */
+    int in_fd;
+    off_t in_offset;
+    int closing;                /* the close is in flight */
+    int error;                  /* errno of the first failure */
+    int finished;               /* job_done has been called for it */
+    struct async_job *next;     /* in the batch */
+    struct async_job *queued;   /* next for the threads */
+} Async_Job;
+
+struct async_batch
+{
+    Async_Job *jobs;
+    size_t pending;             /* not yet closed */
+};
+
+#if USE_THREADS
+
+#if USE_IO_URING
+typedef struct
+{
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned cq_entries;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size, sqes_size;
+    unsigned unsubmitted;
+} Ring;
+#endif /* USE_IO_URING */
+
+struct async_writer
+{
+    pthread_mutex_t lock;
+    pthread_cond_t done;        /* a job has been closed */
+#if USE_IO_URING
+    Ring *ring;                 /* NULL when using the threads */
+    unsigned in_flight;
+    int reaping;                /* someone is waiting on the ring */
+    int ring_error;             /* errno the ring failed with, if it has */
+#endif
+    Async_Job *queue;           /* for the threads */
+    Async_Job **queue_end;
+    pthread_cond_t work;
+    pthread_t threads[ASYNC_THREADS];
+    int num_threads;
+    int stopping;
+};
+
+/* the writer outlives the parses so it is not from their arenas */
+static void*
+async_alloc (size_t size)
+{
+    void *p = calloc (1, size);
+    if (p == NULL)
+    {
+        perror ("async");
+        abort ();
+    }
+    return p;
+}
+
+/* a job is finished with, lock held */
+static void
+job_done (Async_Writer *aw, Async_Job *job)
+{
+    job->finished = 1;
+    job->batch->pending--;
+    pthread_cond_broadcast (&aw->done);
+}
+
+#if USE_IO_URING
+
+static int
+ring_setup (unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall (__NR_io_uring_setup, entries, p);
+}
+
+static int
+ring_enter (int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall (__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, NULL, 0);
+}
+
+static void
+ring_free (Ring *ring)
+{
+    if (ring->sqes) munmap (ring->sqes, ring->sqes_size);
+    if (ring->cq_map && ring->cq_map != ring->sq_map)
+        munmap (ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map) munmap (ring->sq_map, ring->sq_map_size);
+    if (ring->fd >= 0) close (ring->fd);
+    free (ring);
+}
+
+/* whether the kernel can do the writes and closes asked of it */
+static int
+ring_can_write (int fd)
+{
+    size_t size = sizeof (struct io_uring_probe)
+        + 256 * sizeof (struct io_uring_probe_op);
+    struct io_uring_probe *probe = async_alloc (size);
+    int ok = (syscall (__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+                       probe, 256) == 0
+              && probe->last_op >= IORING_OP_WRITE
+              && probe->last_op >= IORING_OP_CLOSE
+              && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)
+              && (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED));
+    free (probe);
+    return ok;
+}
+
+static Ring*
+ring_open (void)
+{
+    struct io_uring_params p;
+    Ring *ring = async_alloc (sizeof (Ring));
+    unsigned char *sq, *cq;
+
+    memset (&p, '\0', sizeof (p));
+    ring->fd = ring_setup (ASYNC_RING_ENTRIES, &p);
+    if (ring->fd < 0 || !ring_can_write (ring->fd)) goto fail;
+
+    ring->sq_map_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+    ring->cq_map_size = p.cq_off.cqes
+        + p.cq_entries * sizeof (struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_map_size > ring->sq_map_size)
+            ring->sq_map_size = ring->cq_map_size;
+        ring->cq_map_size = ring->sq_map_size;
+    }
+    ring->sq_map = mmap (NULL, ring->sq_map_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED)
+    {
+        ring->sq_map = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_map = ring->sq_map;
+    }
+    else
+    {
+        ring->cq_map = mmap (NULL, ring->cq_map_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd,
+                             IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED)
+        {
+            ring->cq_map = NULL;
+            goto fail;
+        }
+    }
+    ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+    ring->sqes = mmap (NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    sq = (unsigned char*)ring->sq_map;
+    ring->sq_head = (unsigned*)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + p.sq_off.array);
+    ring->sq_entries = p.sq_entries;
+    cq = (unsigned char*)ring->cq_map;
+    ring->cq_head = (unsigned*)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    ring->cq_entries = p.cq_entries;
+    return ring;
+
+fail:
+    ring_free (ring);
+    return NULL;
+}
+
+/* The ring is no use any more, lock held.  What it was doing is given
+   up on: each parse fails its unfinished jobs when it comes to wait for
+   them (ring_abandon) rather than anyone leaving from under the lock. */
+static void
+ring_fail (Async_Writer *aw)
+{
+    if (!aw->ring_error)
+    {
+        aw->ring_error = errno;
+        perror ("io_uring_enter");
+    }
+    pthread_cond_broadcast (&aw->done);
+}
+
+/* hands what has been queued to the kernel, lock held */
+static void
+ring_submit (Async_Writer *aw)
+{
+    Ring *ring = aw->ring;
+
+    while (ring->unsubmitted > 0)
+    {
+        int n = ring_enter (ring->fd, ring->unsubmitted, 0, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            /* take back what the kernel never saw */
+            unsigned tail = *ring->sq_tail - ring->unsubmitted;
+            unsigned i;
+            for (i = tail; i != *ring->sq_tail; i++)
+            {
+                struct io_uring_sqe *sqe
+                    = &ring->sqes[ring->sq_array[i & *ring->sq_mask]];
+                if (sqe->opcode == IORING_OP_CLOSE)
+                    ((Async_Job*)(unsigned long)sqe->user_data)->closing = 0;
+            }
+            __atomic_store_n (ring->sq_tail, tail, __ATOMIC_RELEASE);
+            aw->in_flight -= ring->unsubmitted;
+            ring->unsubmitted = 0;
+            ring_fail (aw);
+            return;
+        }
+        ring->unsubmitted -= (unsigned)n;
+    }
+}
+
+/* queues the next thing to be done for job, lock held */
+static void
+ring_queue (Async_Writer *aw, Async_Job *job)
+{
+    Ring *ring = aw->ring;
+    unsigned tail = *ring->sq_tail;
+    unsigned index;
+    struct io_uring_sqe *sqe;
+
+    if (aw->ring_error) return;
+    if (tail - __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE)
+        == ring->sq_entries)
+    {
+        ring_submit (aw);
+        if (aw->ring_error) return;
+    }
+
+    index = tail & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset (sqe, '\0', sizeof (*sqe));
+    sqe->fd = job->fd;
+    if (job->done < job->len)
+    {
+        size_t n = job->len - job->done;
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->addr = (unsigned long)(job->data + job->done);
+        sqe->len = (n < ASYNC_CHUNK_SIZE) ? (unsigned)n : ASYNC_CHUNK_SIZE;
+        sqe->off = job->done;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_CLOSE;
+        job->closing = 1;
+    }
+    sqe->user_data = (unsigned long)job;
+    ring->sq_array[index] = index;
+    __atomic_store_n (ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+    aw->in_flight++;
+}
+
+/* what finished with res did for job, lock held */
+static void
+ring_complete (Async_Writer *aw, Async_Job *job, int res)
+{
+    aw->in_flight--;
+    if (job->closing)
+    {
+        if (res < 0 && !job->error) job->error = -res;
+        job_done (aw, job);
+        return;
+    }
+    if (res <= 0)
+    {
+        /* no more writing, but it still has to be closed */
+        job->error = (res < 0) ? -res : ENOSPC;
+        job->done = job->len;
+    }
+    else
+    {
+        job->done += (size_t)res;
+    }
+    ring_queue (aw, job);
+}
+
+/* Waits for something to complete, or for whoever is waiting already
+   to have dealt with it, lock held */
+static void
+ring_reap (Async_Writer *aw)
+{
+    Ring *ring = aw->ring;
+    unsigned head, tail;
+
+    if (aw->reaping)
+    {
+        pthread_cond_wait (&aw->done, &aw->lock);
+        return;
+    }
+    aw->reaping = 1;
+    ring_submit (aw);
+    if (aw->ring_error)
+    {
+        aw->reaping = 0;
+        return;
+    }
+
+    pthread_mutex_unlock (&aw->lock);
+    if (ring_enter (ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0
+        && errno != EINTR)
+    {
+        pthread_mutex_lock (&aw->lock);
+        aw->reaping = 0;
+        ring_fail (aw);
+        return;
+    }
+    pthread_mutex_lock (&aw->lock);
+
+    head = *ring->cq_head;
+    tail = __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        ring_complete (aw, (Async_Job*)(unsigned long)cqe->user_data,
+                       cqe->res);
+        head++;
+    }
+    __atomic_store_n (ring->cq_head, head, __ATOMIC_RELEASE);
+    ring_submit (aw);
+
+    aw->reaping = 0;
+    pthread_cond_broadcast (&aw->done);
+}
+
+/* fails the jobs of batch the failed ring will not finish, lock held */
+static void
+ring_abandon (Async_Writer *aw, Async_Batch *batch)
+{
+    Async_Job *job;
+
+    for (job = batch->jobs; job; job = job->next)
+    {
+        if (job->finished) continue;
+        if (!job->error) job->error = aw->ring_error;
+        if (!job->closing) close (job->fd);
+        job_done (aw, job);
+    }
+}
+
+#endif /* USE_IO_URING */
+
+/* writes and closes the file of job as file_write would */
+static void
+write_job (Async_Job *job)
+{
+    if (job->in_file)
+    {
+        job->done = output_copy_range (job->fd, job->in_fd, job->in_offset,
+                                       job->len);
+    }
+    while (job->done < job->len)
+    {
+        ssize_t n = write (job->fd, job->data + job->done,
+                           job->len - job->done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+        {
+            job->error = (n < 0) ? errno : ENOSPC;
+            break;
+        }
+        job->done += (size_t)n;
+    }
+    if (close (job->fd) != 0 && !job->error) job->error = errno;
+}
+
+static void*
+async_worker (void *arg)
+{
+    Async_Writer *aw = (Async_Writer*)arg;
+
+    pthread_mutex_lock (&aw->lock);
+    for (;;)
+    {
+        Async_Job *job;
+
+        while (aw->queue == NULL && !aw->stopping)
+            pthread_cond_wait (&aw->work, &aw->lock);
+        if (aw->queue == NULL) break;
+
+        job = aw->queue;
+        aw->queue = job->queued;
+        if (aw->queue == NULL) aw->queue_end = &aw->queue;
+
+        pthread_mutex_unlock (&aw->lock);
+        write_job (job);
+        pthread_mutex_lock (&aw->lock);
+        job_done (aw, job);
+    }
+    pthread_mutex_unlock (&aw->lock);
+    return NULL;
+}
+
+Async_Writer*
+async_open (void)
+{
+    Async_Writer *aw = async_alloc (sizeof (Async_Writer));
+
+    pthread_mutex_init (&aw->lock, NULL);
+    pthread_cond_init (&aw->done, NULL);
+    pthread_cond_init (&aw->work, NULL);
+    aw->queue_end = &aw->queue;
+
+#if USE_IO_URING
+    aw->ring = ring_open ();
+    if (aw->ring) return aw;
+#endif
+
+    for (aw->num_threads = 0; aw->num_threads < ASYNC_THREADS;
+         aw->num_threads++)
+    {
+        if (pthread_create (&aw->threads[aw->num_threads], NULL,
+                            async_worker, aw) != 0)
+            break;
+    }
+    if (aw->num_threads == 0)
+    {
+        async_close (aw);
+        return NULL;
+    }
+    return aw;
+}
+
+void
+async_close (Async_Writer *aw)
+{
+    int i;
+
+    if (aw == NULL) return;
+
+    pthread_mutex_lock (&aw->lock);
+    aw->stopping = 1;
+    pthread_cond_broadcast (&aw->work);
+    pthread_mutex_unlock (&aw->lock);
+    for (i = 0; i < aw->num_threads; i++) pthread_join (aw->threads[i], NULL);
+
+#if USE_IO_URING
+    if (aw->ring) ring_free (aw->ring);
+#endif
+    pthread_cond_destroy (&aw->work);
+    pthread_cond_destroy (&aw->done);
+    pthread_mutex_destroy (&aw->lock);
+    free (aw);
+}
+
+void
+async_write (Async_Writer *aw, Async_Batch **batch, int fd,
+             const char *path, File *file)
+{
+    Async_Job *job = CHECKED_XCALLOC (Async_Job, 1);
+
+    if (*batch == NULL) *batch = CHECKED_XCALLOC (Async_Batch, 1);
+
+    job->batch = *batch;
+    job->path = xstrdup (path);
+    job->fd = fd;
+    job->data = file->data;
+    job->len = file->len;
+    job->in_file = file->in_file;
+    job->in_fd = file->in_fd;
+    job->in_offset = file->in_offset;
+    if (!file->borrowed)
+    {
+        job->owned = file->data;
+        file->data = NULL;
+    }
+    job->next = (*batch)->jobs;
+    (*batch)->jobs = job;
+
+    pthread_mutex_lock (&aw->lock);
+    (*batch)->pending++;
+#if USE_IO_URING
+    if (aw->ring && !aw->ring_error)
+    {
+        while (aw->in_flight >= aw->ring->cq_entries && !aw->ring_error)
+            ring_reap (aw);
+        ring_queue (aw, job);
+        ring_submit (aw);
+        pthread_mutex_unlock (&aw->lock);
+        return;
+    }
+    if (aw->ring)
+    {
+        /* there are no threads to hand it to */
+        pthread_mutex_unlock (&aw->lock);
+        write_job (job);
+        pthread_mutex_lock (&aw->lock);
+        job_done (aw, job);
+        pthread_mutex_unlock (&aw->lock);
+        return;
+    }
+#endif
+    *aw->queue_end = job;
+    aw->queue_end = &job->queued;
+    pthread_cond_signal (&aw->work);
+    pthread_mutex_unlock (&aw->lock);
+}
+
+int
+async_wait (Async_Writer *aw, Async_Batch **batch)
+{
+    Async_Job *job;
+    int failed = 0;
+
+    if (*batch == NULL) return 0;
+
+    pthread_mutex_lock (&aw->lock);
+    while ((*batch)->pending > 0)
+    {
+#if USE_IO_URING
+        if (aw->ring && aw->ring_error)
+        {
+            ring_abandon (aw, *batch);
+            break;
+        }
+        if (aw->ring)
+        {
+            ring_reap (aw);
+            continue;
+        }
+#endif
+        pthread_cond_wait (&aw->done, &aw->lock);
+    }
+    pthread_mutex_unlock (&aw->lock);
+
+    /* freed here, by the thread whose arena they may be from */
+    while ((job = (*batch)->jobs) != NULL)
+    {
+        (*batch)->jobs = job->next;
+        if (job->error)
+        {
+            fprintf (stderr, "%s: %s\n", job->path, strerror (job->error));
+            failed++;
+        }
+        XFREE (job->owned);
+        XFREE (job->path);
+        XFREE (job);
+    }
+    XFREE (*batch);
+    return failed;
+}
+
+#else /* !USE_THREADS */
+
+Async_Writer*
+async_open (void)
+{
+    return NULL;
+}
+
+void
+async_close (Async_Writer *aw)
+{
+    (void)aw;
+}
+
+void
+async_write (Async_Writer *aw, Async_Batch **batch, int fd,
+             const char *path, File *file)
+{
+    /* async_open never gave anyone a writer */
+    (void)aw; (void)batch; (void)fd; (void)path; (void)file;
+    abort ();
+}
+
+int
+async_wait (Async_Writer *aw, Async_Batch **batch)
+{
+    (void)aw; (void)batch;
+    return 0;
+}
+
+#endif /* USE_THREADS */
+
+int
+async_pending (const Async_Batch *batch, const char *path)
+{
+    const Async_Job *job;
+
+    if (batch == NULL) return 0;
+    for (job = batch->jobs; job; job = job->next)
+    {
+        if (strcmp (job->path, path) == 0) return 1;
+    }
+    return 0;
+}
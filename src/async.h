@@ -0,0 +1,57 @@
+/*
+ * async.h -- write the files in the background
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include "file.h"
+
+typedef struct async_writer Async_Writer;
+typedef struct async_batch Async_Batch;
+
+/* Starts the writer, with io_uring where the kernel has it and a few
+   threads otherwise.  Returns NULL if neither can be had, when files
+   are to be written as usual.  One writer serves any number of
+   parses, each with its own batch. */
+extern Async_Writer* async_open (void);
+extern void async_close (Async_Writer *aw);
+
+/* Writes the data of file to fd, which is closed after, adding it to
+   *batch (started if NULL).  The data is taken over from file unless it
+   is borrowed, and either way must stay put until async_wait.  path is
+   only for messages. */
+extern void async_write (Async_Writer *aw, Async_Batch **batch, int fd,
+                         const char *path, File *file);
+
+/* Whether path is being written in batch */
+extern int async_pending (const Async_Batch *batch, const char *path);
+
+/* Waits for all of batch to be written and ends it, reporting the
+   files that could not be.  Returns how many there were. */
+extern int async_wait (Async_Writer *aw, Async_Batch **batch);
+
+#endif /* ASYNC_H */
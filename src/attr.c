@@ -27,6 +27,7 @@
 
 #include "alloc.h"
 #include "attr.h"
+#include "checksum.h"
 #include "tnef_types.h"
 #include "tnef_names.h"
 #include "date.h"
@@ -41,8 +42,8 @@ copy_date_from_attr (Attr* attr, struct date* dt)
 {
     assert (attr);
     assert (dt);
-    assert (attr->type == szDATE);
-    assert (attr->len >= 14);
+    CHECKINPUT (attr->type == szDATE);
+    CHECKINPUT (attr->len >= 14);
 
     date_read (dt, attr->buf);
 }
@@ -52,8 +53,8 @@ copy_triple_from_attr (Attr* attr, TRIPLE *t)
 {
     assert (attr);
     assert (t);
-    assert (attr->type == szTRIPLES);
-    assert (attr->len > 8);
+    CHECKINPUT (attr->type == szTRIPLES);
+    CHECKINPUT (attr->len > 8);
 
     t->trp.id = GETINT16 (attr->buf);
     t->trp.chbgtrp = GETINT16 (attr->buf+2);
@@ -61,97 +62,115 @@ copy_triple_from_attr (Attr* attr, TRIPLE *t)
     t->trp.cb = GETINT16 (attr->buf+6);
     t->sender_display_name = (char*)(attr->buf+8);
 
-    assert (attr->len > 8+t->trp.cch);
+    CHECKINPUT (attr->len > 8+t->trp.cch);
 
     t->sender_address = (char*)(attr->buf+8+t->trp.cch);
 }
 
 /* attr_dump
    print attr to stdout.  Assumes that the Debug flag has been set and
-   already checked */
+   already checked.  Byte, word and dword values are cut short at
+   ctx->dump_limit bytes when that is set. */
 void
-attr_dump (Attr* attr)
+attr_dump (TNEF_Context *ctx, Attr* attr)
 {
-    char *name = get_tnef_name_str (attr->name);
-    char *type = get_tnef_type_str (attr->type);
-    size_t i;
-
-    fprintf (stdout, "(%s) %s [type: %s] [len: %lu] =",
-             ((attr->lvl_type == LVL_MESSAGE) ? "MESS" : "ATTA"),
-             name, type, (unsigned long)attr->len);
+    Writer w;
+    size_t i, shown;
+
+    writer_open (&w, stdout, ctx->dump_limit);
+    write_text (&w, ((attr->lvl_type == LVL_MESSAGE)
+                     ? "(MESS) " : "(ATTA) "));
+    write_name (&w, tnef_name_to_str (attr->name), attr->name);
+    write_text (&w, " [type: ");
+    write_name (&w, tnef_type_to_str (attr->type), attr->type);
+    write_text (&w, "] [len: ");
+    write_unsigned (&w, (unsigned long)attr->len);
+    write_text (&w, "] =");
 
     switch (attr->type)
     {
     case szBYTE:
         if (attr->name == attOEMCODEPAGE)
         {
-            fprintf(stdout, " CodePage - Primary: %u, Secondary: %u",
-                    GETINT32(attr->buf), GETINT32(attr->buf + 4));
+            write_text (&w, " CodePage - Primary: ");
+            write_uint32 (&w, GETINT32(attr->buf));
+            write_text (&w, ", Secondary: ");
+            write_uint32 (&w, GETINT32(attr->buf + 4));
         }
         else
         {
-            for (i=0; i < attr->len; i++)
-            {
-                fputc (' ', stdout);
-                write_byte(stdout, (uint8)attr->buf[i]);
-            }
+            write_bytes (&w, attr->buf, attr->len, ' ', '\0');
         }
         break;
 
     case szSHORT:
         if (attr->len < sizeof(uint16))
         {
-            fprintf (stdout, "Not enough data for szSHORT");
+            write_text (&w, "Not enough data for szSHORT");
+            writer_close (&w);
             abort();
         }
-        fputc (' ', stdout);
-        write_uint16 (stdout, GETINT16(attr->buf));
+        write_char (&w, ' ');
+        write_uint16 (&w, GETINT16(attr->buf));
         if (attr->len > sizeof(uint16))
         {
-            fprintf (stdout, " [extra data:");
+            write_text (&w, " [extra data:");
             for (i = sizeof(uint16); i < attr->len; i++)
             {
-                fputc (' ', stdout);
-                write_uint8 (stdout, (uint8)attr->buf[i]);
+                write_char (&w, ' ');
+                write_uint8 (&w, (uint8)attr->buf[i]);
             }
-            fprintf (stdout, " ]");
+            write_text (&w, " ]");
         }
         break;
 
     case szLONG:
         if (attr->len < sizeof(uint32))
         {
-            fprintf (stdout, "Not enough data for szLONG");
+            write_text (&w, "Not enough data for szLONG");
+            writer_close (&w);
             abort();
         }
-        fputc (' ', stdout);
-        write_uint32 (stdout, GETINT32(attr->buf));
+        write_char (&w, ' ');
+        write_uint32 (&w, GETINT32(attr->buf));
         if (attr->len > sizeof(uint32))
         {
-            fprintf (stdout, " [extra data:");
+            write_text (&w, " [extra data:");
             for (i = sizeof(uint32); i < attr->len; i++)
             {
-                fputc (' ', stdout);
-                write_uint8 (stdout, (uint8)attr->buf[i]);
+                write_char (&w, ' ');
+                write_uint8 (&w, (uint8)attr->buf[i]);
             }
-            fprintf (stdout, " ]");
+            write_text (&w, " ]");
         }
         break;
 
 
     case szWORD:
-        for (i=0; i < attr->len; i+=2)
+        shown = write_shown (&w, attr->len);
+        for (i=0; i < shown; i+=2)
         {
-            fputc (' ', stdout);
-            write_word(stdout, GETINT16(attr->buf+i));
+            write_char (&w, ' ');
+            write_word (&w, GETINT16(attr->buf+i));
+        }
+        if (i < attr->len)
+        {
+            write_char (&w, ' ');
+            write_more (&w, attr->len - i);
         }
         break;
 
     case szDWORD:
-        for (i=0; i < attr->len; i+=4)
+        shown = write_shown (&w, attr->len);
+        for (i=0; i < shown; i+=4)
+        {
+            write_char (&w, ' ');
+            write_dword (&w, GETINT32(attr->buf+i));
+        }
+        if (i < attr->len)
         {
-            fputc (' ', stdout);
-            write_dword (stdout, GETINT32(attr->buf+i));
+            write_char (&w, ' ');
+            write_more (&w, attr->len - i);
         }
         break;
 
@@ -159,19 +178,20 @@ attr_dump (Attr* attr)
     {
         struct date dt;
         copy_date_from_attr (attr, &dt);
-        fputc (' ', stdout);
-        write_date (stdout, &dt);
+        write_char (&w, ' ');
+        write_date (&w, &dt);
     }
     break;
 
     case szTEXT:
     case szSTRING:
     {
-        char* buf = CHECKED_XMALLOC (char, (attr->len + 1));
-        strncpy (buf, (char*)attr->buf, attr->len);
-        buf[attr->len] = '\0';
-        write_string (stdout, buf);
-        XFREE (buf);
+        /* up to the first NUL, without copying it out to terminate it */
+        const unsigned char *end = memchr (attr->buf, '\0', attr->len);
+        write_char (&w, '\'');
+        write_chars (&w, (const char*)attr->buf,
+                     (end ? (size_t)(end - attr->buf) : attr->len));
+        write_char (&w, '\'');
     }
     break;
 
@@ -179,16 +199,16 @@ attr_dump (Attr* attr)
     {
         TRIPLE triple;
         copy_triple_from_attr (attr, &triple);
-        write_triple (stdout, &triple);
+        write_triple (&w, &triple);
     }
     break;
 
     default:
-        fprintf (stdout, "<unknown type>");
+        write_text (&w, "<unknown type>");
         break;
     }
-    fprintf (stdout, "\n");
-    fflush( NULL );
+    write_char (&w, '\n');
+    writer_close (&w);
 }
 
 void
@@ -196,26 +216,21 @@ attr_free (Attr* attr)
 {
     if (attr)
     {
-        XFREE (attr->buf);
+        if (!attr->borrowed) XFREE (attr->buf);
         memset (attr, '\0', sizeof (Attr));
     }
 }
 
 
 /* Validate the checksum against attr.  The checksum is the sum of all the
-   bytes in the attribute data modulo 65536 */
+   bytes in the attribute data modulo 65536, sum is what was computed
+   while reading the data. */
 static int
-check_checksum (Attr* attr, uint16 checksum)
+check_checksum (TNEF_Context *ctx, Attr* attr, uint16 sum, uint16 checksum)
 {
     size_t i;
-    uint32 sum = 0;
-
-    for (i = 0; i < attr->len; i++)
-    {
-        sum = ( sum + (uint8)attr->buf[i] ) & 0xffff;
-    }
 
-    if (DEBUG_ON)
+    if (DEBUG_ON(ctx))
     {
         if ( sum != checksum )
         {
@@ -231,56 +246,132 @@ check_checksum (Attr* attr, uint16 checksum)
                 if ( mysum == checksum ) match = i;
             }
 
-            debug_print( "!!checksum error: length=%d sum=%04x checksum=%04x match=%d\n", attr->len, mysum, checksum, match );
+            debug_print( ctx, "!!checksum error: length=%d sum=%04x checksum=%04x match=%d\n", attr->len, mysum, checksum, match );
         }
     }
 
     return (sum == checksum);
 }
 
+/* Report an invalid checksum.  Exits unless checksum errors are being
+   ignored. */
+void
+attr_checksum_failed (TNEF_Context *ctx)
+{
+    ctx->checksum_errors++;
+    if ( CHECKSUM_SKIP(ctx) )
+    {
+        fprintf (stderr,
+                 "WARNING: invalid checksum, input file may be corrupted\n");
+    }
+    else
+    {
+        fprintf (stderr,
+                 "ERROR: invalid checksum, input file may be corrupted\n");
+        tnef_exit (1);
+    }
+}
+
+/* small enough to stay in the L1/L2 cache between copying and summing */
+#define CHECKSUM_CHUNK_SIZE (16 * 1024)
+
+/* Attributes which carry the (possibly large) payloads.  Their consumers
+   only ever use the data together with its length so the data can be
+   left in place when the input is mapped. */
+static int
+is_payload_attr (tnef_name name)
+{
+    return (name == attATTACHDATA
+            || name == attATTACHMENT
+            || name == attMAPIPROPS);
+}
+
+/* Reads the level, type, name and length of the next attribute but
+   none of its data.  The data must be consumed with attr_read_data or
+   by the caller followed by the checksum. */
 Attr*
-attr_read (FILE* in)
+attr_read_header (Input* in)
 {
     uint32 type_and_name;
-    uint16 checksum;
 
     Attr *attr = CHECKED_XCALLOC (Attr, 1);
 
     attr->lvl_type = geti8(in);
 
-    assert ((attr->lvl_type == LVL_MESSAGE)
-            || (attr->lvl_type == LVL_ATTACHMENT));
+    CHECKINPUT ((attr->lvl_type == LVL_MESSAGE)
+                || (attr->lvl_type == LVL_ATTACHMENT));
 
     type_and_name = geti32(in);
 
     attr->type = (type_and_name >> 16);
     attr->name = ((type_and_name << 16) >> 16);
     attr->len = geti32(in);
-    /* Allocate an extra byte for the null terminator,
-       in case the input lacks it,
-       this avoids strdup() being invoked on possibly non-terminated
-       input later (file.c, file_add_attr()). */
-    attr->buf = CHECKED_XCALLOC_ADDNULL(unsigned char, attr->len);
 
-    (void)getbuf(in, attr->buf, attr->len);
+    return attr;
+}
+
+/* Copies n bytes of input into buf, returning their checksum.  This is
+   done a cache sized piece at a time so that each piece is summed while
+   it is still in the cache rather than in a second pass over buf. */
+static uint16
+getbuf_checksum (Input *in, unsigned char *buf, size_t n)
+{
+    uint16 sum = 0;
+
+    while (n > 0)
+    {
+        size_t chunk = (n < CHECKSUM_CHUNK_SIZE) ? n : CHECKSUM_CHUNK_SIZE;
+
+        (void)getbuf (in, buf, chunk);
+        sum = checksum16 (sum, buf, chunk);
+        buf += chunk;
+        n -= chunk;
+    }
+    return sum;
+}
+
+/* Reads the data and checksum of an attribute whose header has been
+   read by attr_read_header */
+void
+attr_read_data (TNEF_Context *ctx, Input* in, Attr* attr)
+{
+    uint16 sum;
+    uint16 checksum;
+
+    if (in->map && is_payload_attr (attr->name))
+    {
+        /* nothing is allocated but --maxsize still applies */
+        alloc_limit_assert ("attr_read", attr->len);
+        attr->buf = input_view (in, attr->len);
+        attr->borrowed = 1;
+        sum = checksum16 (0, attr->buf, attr->len);
+    }
+    else
+    {
+        /* Allocate an extra byte for the null terminator,
+           in case the input lacks it,
+           this avoids strdup() being invoked on possibly non-terminated
+           input later (file.c, file_add_attr()).  Every other byte is
+           about to be overwritten so there is no point clearing them. */
+        attr->buf = CHECKED_XMALLOC_ADDNULL(unsigned char, attr->len);
+        attr->buf[attr->len] = '\0';
+
+        sum = getbuf_checksum (in, attr->buf, attr->len);
+    }
 
     checksum = geti16(in);
-    if (!check_checksum(attr, checksum))
+    if (!check_checksum(ctx, attr, sum, checksum))
     {
-        if ( CHECKSUM_SKIP )
-        {
-            fprintf (stderr,
-                 "WARNING: invalid checksum, input file may be corrupted\n");
-        }
-        else
-        {
-            fprintf (stderr,
-                 "ERROR: invalid checksum, input file may be corrupted\n");
-            exit( 1 );
-        }
+        attr_checksum_failed (ctx);
     }
 
-    if (DEBUG_ON) attr_dump (attr);
+    if (DEBUG_ON(ctx)) attr_dump (ctx, attr);
+}
 
+Attr*
+attr_read (TNEF_Context *ctx, Input* in)
+{
+    Attr *attr = attr_read_header (in);
+    attr_read_data (ctx, in, attr);
     return attr;
 }
@@ -28,6 +28,8 @@
 
 #include "common.h"
 #include "date.h"
+#include "input.h"
+#include "options.h"
 #include "tnef_types.h"
 #include "tnef_names.h"
 
@@ -47,6 +49,7 @@ typedef struct
     level_type lvl_type;
     tnef_type type;
     tnef_name name;
+    int borrowed;               /* buf points into the input mapping */
     size_t len;
     unsigned char* buf;
 } Attr;
@@ -66,9 +69,12 @@ typedef struct
     char* sender_address;
 } TRIPLE;
 
-extern void attr_dump (Attr* attr);
+extern void attr_dump (TNEF_Context *ctx, Attr* attr);
 extern void attr_free (Attr* attr);
 extern void copy_date_from_attr (Attr* attr, struct date* dt);
-extern Attr* attr_read (FILE* in);
+extern Attr* attr_read (TNEF_Context *ctx, Input* in);
+extern Attr* attr_read_header (Input* in);
+extern void attr_read_data (TNEF_Context *ctx, Input* in, Attr* attr);
+extern void attr_checksum_failed (TNEF_Context *ctx);
 
 #endif /* ATTR_H */
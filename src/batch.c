@@ -0,0 +1,382 @@
+/*
+ * batch.c -- extract many TNEF files in one go
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       Each input file FOO is extracted into the directory FOO.d (FOO-2.d
+ *       and so on when several inputs have the same name) by one of a
+ *       pool of worker threads.  A file which cannot be parsed does not
+ *       stop the others, parse_file giving up through tnef_exit returns
+ *       to run_job below.  Assertion failures still abort everything.
+ *       With --tar the directories are only the names given to the
+ *       members of the stream.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include <dirent.h>
+#include <errno.h>
+
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#if HAVE_PTHREAD_H && HAVE_TLS
+#  include <pthread.h>
+#  define USE_THREADS 1
+#endif
+
+#include "alloc.h"
+#include "batch.h"
+#include "options.h"
+#include "path.h"
+#include "tnef.h"
+#include "util.h"
+
+typedef struct
+{
+    char *input;
+    char *directory;
+    int status;
+} Batch_Job;
+
+typedef struct
+{
+    Batch_Job *jobs;
+    size_t count;
+    size_t next;                /* first job not yet taken */
+    char *body_file;
+    char *body_pref;
+    const TNEF_Context *options; /* copied for each job */
+#if USE_THREADS
+    pthread_mutex_t lock;
+#endif
+} Batch;
+
+typedef struct
+{
+    char **names;
+    size_t count;
+    size_t size;
+} Name_List;
+
+static void
+add_name (Name_List *list, const char *name)
+{
+    if (list->count == list->size)
+    {
+        char **names;
+        list->size = list->size ? 2 * list->size : 64;
+        names = XMALLOC (char*, list->size);
+        if (list->count)
+            memmove (names, list->names, list->count * sizeof (char*));
+        XFREE (list->names);
+        list->names = names;
+    }
+    list->names[list->count++] = xstrdup (name);
+}
+
+static int
+compare_names (const void *a, const void *b)
+{
+    return strcmp (*(char* const*)a, *(char* const*)b);
+}
+
+/* adds the regular files of directory dir, in sorted order */
+static void
+add_directory (Name_List *list, const char *dir)
+{
+    DIR *d = opendir (dir);
+    struct dirent *entry;
+    struct stat statbuf;
+    size_t first = list->count;
+
+    if (d == NULL)
+    {
+        perror (dir);
+        return;
+    }
+    while ((entry = readdir (d)) != NULL)
+    {
+        char *path;
+
+        if (entry->d_name[0] == '.') continue;
+
+        path = concat_fname (dir, entry->d_name);
+        if (stat (path, &statbuf) == 0 && S_ISREG (statbuf.st_mode))
+            add_name (list, path);
+        XFREE (path);
+    }
+    closedir (d);
+
+    qsort (list->names + first, list->count - first, sizeof (char*),
+           compare_names);
+}
+
+/* Adds the files listed on stdin.  The names are separated by newlines
+   or, if there is any NUL in the list (as from find -print0), by NULs */
+static void
+add_stdin_list (Name_List *list)
+{
+    size_t size = 4096, len = 0, n;
+    char *buf = XMALLOC (char, size + 1);
+    char sep = '\n';
+    char *p, *end;
+
+    while ((n = fread (buf + len, 1, size - len, stdin)) > 0)
+    {
+        len += n;
+        if (len == size)
+        {
+            char *bigger = XMALLOC (char, 2 * size + 1);
+            memmove (bigger, buf, len);
+            XFREE (buf);
+            buf = bigger;
+            size *= 2;
+        }
+    }
+    buf[len] = '\0';
+
+    if (memchr (buf, '\0', len)) sep = '\0';
+
+    for (p = buf, end = buf + len; p < end; p += strlen (p) + 1)
+    {
+        char *q = memchr (p, sep, end - p);
+        if (q) *q = '\0';
+        if (sep == '\n' && *p && p[strlen (p) - 1] == '\r')
+            p[strlen (p) - 1] = '\0';
+        if (*p) add_name (list, p);
+    }
+    XFREE (buf);
+}
+
+/* Names the output directory of every job after its input.  Inputs are
+   sorted by name so that those with the same name are next to each
+   other and can be numbered in the order they were given. */
+static int
+compare_jobs (const void *a, const void *b)
+{
+    const Batch_Job *x = *(Batch_Job* const*)a;
+    const Batch_Job *y = *(Batch_Job* const*)b;
+    int c = strcmp (x->directory, y->directory);
+    if (c) return c;
+    return (x < y) ? -1 : (x > y);
+}
+
+static void
+name_directories (Batch_Job *jobs, size_t count, const char *out_dir)
+{
+    Batch_Job **sorted = XMALLOC (Batch_Job*, count);
+    size_t *nth = XMALLOC (size_t, count);
+    size_t i;
+
+    /* to begin with directory is just the base name of the input */
+    for (i = 0; i < count; i++)
+    {
+        char *base = strrchr (jobs[i].input, '/');
+        jobs[i].directory = xstrdup (base ? base + 1 : jobs[i].input);
+        sorted[i] = &jobs[i];
+    }
+    qsort (sorted, count, sizeof (Batch_Job*), compare_jobs);
+
+    for (i = 0; i < count; i++)
+    {
+        if (i > 0 && strcmp (sorted[i-1]->directory, sorted[i]->directory) == 0)
+            nth[i] = nth[i-1] + 1;
+        else
+            nth[i] = 1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        Batch_Job *job = sorted[i];
+        char *name = XMALLOC (char, strlen (job->directory) + 32);
+
+        if (nth[i] == 1)
+            sprintf (name, "%s.d", job->directory);
+        else
+            sprintf (name, "%s-%lu.d", job->directory, (unsigned long)nth[i]);
+
+        XFREE (job->directory);
+        job->directory = concat_fname (out_dir, name);
+        XFREE (name);
+    }
+    XFREE (nth);
+    XFREE (sorted);
+}
+
+static void
+run_job (Batch *batch, Batch_Job *job)
+{
+    TNEF_Context ctx;
+    jmp_buf point;
+    FILE *fp;
+    int status;
+
+    if (!batch->options->tar
+        && mkdir (job->directory, 0777) != 0 && errno != EEXIST)
+    {
+        perror (job->directory);
+        job->status = 1;
+        return;
+    }
+
+    fp = fopen (job->input, "rb");
+    if (fp == NULL)
+    {
+        perror (job->input);
+        job->status = 1;
+        return;
+    }
+
+    context_init (&ctx, batch->options->flags, batch->options->alloc_limit);
+    ctx.dump_limit = batch->options->dump_limit;
+    ctx.source = job->input;
+    ctx.tar = batch->options->tar;
+    ctx.store = batch->options->store;
+    ctx.async = batch->options->async;
+    ctx.props = batch->options->props;
+    ctx.num_props = batch->options->num_props;
+    status = setjmp (point);
+    if (status == 0)
+    {
+        set_exit_point (&point);
+        status = parse_file (&ctx, fp, job->directory,
+                             batch->body_file, batch->body_pref);
+    }
+    else
+    {
+        parse_file_abandon (&ctx);
+    }
+    set_exit_point (NULL);
+
+    fclose (fp);
+    job->status = status;
+}
+
+static Batch_Job*
+next_job (Batch *batch)
+{
+    Batch_Job *job = NULL;
+
+#if USE_THREADS
+    pthread_mutex_lock (&batch->lock);
+#endif
+    if (batch->next < batch->count) job = &batch->jobs[batch->next++];
+#if USE_THREADS
+    pthread_mutex_unlock (&batch->lock);
+#endif
+    return job;
+}
+
+static void*
+worker (void *arg)
+{
+    Batch *batch = (Batch*)arg;
+    Batch_Job *job;
+
+    while ((job = next_job (batch)) != NULL)
+    {
+        run_job (batch, job);
+    }
+    alloc_arena_release ();
+    return NULL;
+}
+
+int
+run_batch (char **args, int nargs, const char *out_dir,
+           int jobs, char *body_file, char *body_pref,
+           const TNEF_Context *ctx)
+{
+    Name_List inputs;
+    Batch batch;
+    int i, failed = 0;
+    size_t j;
+
+    memset (&inputs, '\0', sizeof (Name_List));
+    if (nargs == 0) add_stdin_list (&inputs);
+    for (i = 0; i < nargs; i++)
+    {
+        struct stat statbuf;
+        if (stat (args[i], &statbuf) == 0 && S_ISDIR (statbuf.st_mode))
+            add_directory (&inputs, args[i]);
+        else
+            add_name (&inputs, args[i]);
+    }
+
+    memset (&batch, '\0', sizeof (Batch));
+    batch.count = inputs.count;
+    batch.jobs = XCALLOC (Batch_Job, batch.count + 1);
+    for (j = 0; j < batch.count; j++) batch.jobs[j].input = inputs.names[j];
+    name_directories (batch.jobs, batch.count, out_dir);
+    batch.body_file = body_file;
+    batch.body_pref = body_pref;
+    batch.options = ctx;
+
+    if (jobs < 1) jobs = 1;
+    if ((size_t)jobs > batch.count) jobs = (int)batch.count;
+
+#if USE_THREADS
+    if (jobs > 1)
+    {
+        pthread_t *threads = XMALLOC (pthread_t, jobs);
+        int started;
+
+        pthread_mutex_init (&batch.lock, NULL);
+        for (started = 0; started < jobs - 1; started++)
+        {
+            if (pthread_create (&threads[started], NULL, worker, &batch) != 0)
+                break;
+        }
+        worker (&batch);        /* this thread helps out too */
+        for (i = 0; i < started; i++) pthread_join (threads[i], NULL);
+        pthread_mutex_destroy (&batch.lock);
+        XFREE (threads);
+    }
+    else
+#endif /* USE_THREADS */
+    {
+        worker (&batch);
+    }
+
+    for (j = 0; j < batch.count; j++)
+    {
+        Batch_Job *job = &batch.jobs[j];
+
+        if (job->status != 0)
+        {
+            fprintf (stderr, "tnef: %s: failed\n", job->input);
+            failed = 1;
+        }
+        else if (VERBOSE_ON(ctx))
+        {
+            fprintf (stdout, "tnef: %s: extracted into %s\n",
+                     job->input, job->directory);
+        }
+        XFREE (job->input);
+        XFREE (job->directory);
+    }
+    XFREE (batch.jobs);
+    XFREE (inputs.names);
+
+    return failed;
+}
@@ -0,0 +1,40 @@
+/*
+ * batch.h -- extract many TNEF files in one go
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+#include "options.h"
+
+/* Extracts each of the files named by args (or, for a directory, each
+   file in it, or if nargs is 0, each file listed on stdin) into a
+   directory of its own below out_dir, using up to jobs threads.
+   Returns 0 if all of them were extracted, 1 otherwise. */
+extern int run_batch (char **args, int nargs, const char *out_dir,
+                      int jobs, char *body_file, char *body_pref,
+                      const TNEF_Context *ctx);
+
+#endif /* BATCH_H */
@@ -0,0 +1,353 @@
+/*
+ * bench.c -- micro-benchmarks for the inner loops of tnef
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       Not installed; built by 'make bench'.  Every kernel is checked
+ *       against the first (reference) one before it is timed.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+#include <time.h>
+
+#include "checksum.h"
+#include "crc.h"
+#include "unicode.h"
+
+/* roughly how many bytes each kernel gets to chew on per buffer size */
+#define BENCH_VOLUME (256UL * 1024 * 1024)
+
+static const size_t buffer_sizes[] = { 1024, 64 * 1024, 16 * 1024 * 1024 };
+#define NUM_SIZES (sizeof (buffer_sizes) / sizeof (buffer_sizes[0]))
+
+static double
+now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char*
+random_buffer (size_t len)
+{
+    unsigned char *buf = malloc (len);
+    uint32 x = 0x12345678;
+    size_t i;
+
+    if (buf == NULL)
+    {
+        perror ("malloc");
+        exit (1);
+    }
+    for (i = 0; i < len; i++)
+    {
+        x = x * 1103515245 + 12345;
+        buf[i] = (unsigned char)(x >> 16);
+    }
+    return buf;
+}
+
+static void
+report (const char *what, const char *kernel, size_t len,
+        size_t iterations, double secs)
+{
+    fprintf (stdout, "%-10s %-6s %10lu bytes %10.1f MB/s\n",
+             what, kernel, (unsigned long)len,
+             (len * (double)iterations) / (secs * 1024 * 1024));
+}
+
+static int
+bench_checksum (void)
+{
+    int errors = 0;
+    size_t s;
+
+    for (s = 0; s < NUM_SIZES; s++)
+    {
+        size_t len = buffer_sizes[s];
+        size_t iterations = BENCH_VOLUME / len;
+        unsigned char *buf = random_buffer (len);
+        uint16 expected = checksum_kernels[0].fn (0, buf, len);
+        int k;
+
+        for (k = 0; checksum_kernels[k].name; k++)
+        {
+            const Checksum_Kernel *kernel = &checksum_kernels[k];
+            volatile uint16 sink = 0;
+            double start;
+            size_t i;
+
+            if (!kernel->usable ()) continue;
+
+            if (kernel->fn (0, buf, len) != expected
+                || kernel->fn (0, buf + 1, len - 1)
+                   != checksum_kernels[0].fn (0, buf + 1, len - 1))
+            {
+                fprintf (stderr, "checksum: %s kernel gives wrong result\n",
+                         kernel->name);
+                errors++;
+                continue;
+            }
+
+            start = now ();
+            for (i = 0; i < iterations; i++)
+            {
+                sink += kernel->fn (0, buf, len);
+            }
+            report ("checksum", kernel->name, len, iterations, now () - start);
+        }
+        free (buf);
+    }
+    return errors;
+}
+
+static int
+bench_crc (void)
+{
+    int errors = 0;
+    size_t s;
+
+    for (s = 0; s < NUM_SIZES; s++)
+    {
+        size_t len = buffer_sizes[s];
+        size_t iterations = BENCH_VOLUME / len;
+        unsigned char *buf = random_buffer (len);
+        int k;
+
+        for (k = 0; crc32_kernels[k].name; k++)
+        {
+            const Crc_Kernel *kernel = &crc32_kernels[k];
+            volatile uint32 sink = 0;
+            double start;
+            size_t i, n;
+
+            if (!kernel->usable ()) continue;
+
+            /* every length up to 300 covers all the tail handling */
+            for (n = 0; n <= len && n <= 300; n++)
+            {
+                if (kernel->fn (0x12345678, buf + 1, n)
+                    != crc32_kernels[0].fn (0x12345678, buf + 1, n))
+                    break;
+            }
+            if ((n <= len && n <= 300)
+                || kernel->fn (0, buf, len) != crc32_kernels[0].fn (0, buf, len))
+            {
+                fprintf (stderr, "crc: %s kernel gives wrong result\n",
+                         kernel->name);
+                errors++;
+                continue;
+            }
+
+            start = now ();
+            for (i = 0; i < iterations; i++)
+            {
+                sink += kernel->fn (0, buf, len);
+            }
+            report ("crc", kernel->name, len, iterations, now () - start);
+        }
+        free (buf);
+    }
+    return errors;
+}
+
+/* unicode_to_utf8 as it was before the kernels, one unit at a time
+   into an allocation for the worst case, for comparison */
+static unsigned char*
+scalar_to_utf8 (size_t len, const unsigned char *buf)
+{
+    unsigned char *utf8 = malloc (3 * (len / 2) + 1);
+    size_t i, j = 0;
+
+    for (i = 0; i + 1 < len; i += 2)
+    {
+        uint32 c = (uint32)buf[i] | ((uint32)buf[i+1] << 8);
+        if (c <= 0x7f)
+        {
+            utf8[j++] = (unsigned char)c;
+        }
+        else if (c <= 0x7ff)
+        {
+            utf8[j++] = 0xc0 | (c >> 6);
+            utf8[j++] = 0x80 | (c & 0x3f);
+        }
+        else
+        {
+            utf8[j++] = 0xe0 | (c >> 12);
+            utf8[j++] = 0x80 | ((c >> 6) & 0x3f);
+            utf8[j++] = 0x80 | (c & 0x3f);
+        }
+    }
+    utf8[j] = '\0';
+    return utf8;
+}
+
+/* UTF-16LE text, one unit in every 'stride' being non-ASCII */
+static unsigned char*
+utf16_buffer (size_t units, size_t stride)
+{
+    unsigned char *buf = random_buffer (units * 2);
+    size_t i;
+
+    for (i = 0; i < units; i++)
+    {
+        if (stride && i % stride == stride - 1)
+        {
+            buf[2*i+1] = 0x04;          /* cyrillic */
+        }
+        else
+        {
+            buf[2*i] = 0x20 + buf[2*i] % 0x5f;
+            buf[2*i+1] = 0;
+        }
+    }
+    return buf;
+}
+
+static int
+bench_unicode (void)
+{
+    static const size_t strides[] = { 0, 7, 40 };
+    /* most MAPI strings are names and subjects, only a few dozen units */
+    static const size_t sizes[] = { 16, 64, 1024, 64 * 1024,
+                                    16 * 1024 * 1024 };
+    int errors = 0;
+    size_t s, t;
+
+    for (s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++)
+    {
+        for (t = 0; t < sizeof (strides) / sizeof (strides[0]); t++)
+        {
+            size_t units = sizes[s] / 2;
+            size_t iterations = BENCH_VOLUME / sizes[s] / 8;
+            unsigned char *buf = utf16_buffer (units, strides[t]);
+            unsigned char *out = malloc (units + 1);
+            unsigned char *expected = malloc (units + 1);
+            char what[32];
+            int k;
+
+            sprintf (what, "utf8/%lu", (unsigned long)strides[t]);
+            for (k = 0; ascii_run_kernels[k].name; k++)
+            {
+                const Ascii_Run_Kernel *kernel = &ascii_run_kernels[k];
+                volatile size_t sink = 0;
+                double start;
+                size_t i, n;
+
+                if (!kernel->usable ()) continue;
+
+                for (n = 0; n < 100 && n < units; n++)
+                {
+                    size_t m = units - n;
+                    size_t r = ascii_run_kernels[0].fn (buf + 2*n, m,
+                                                        expected);
+                    if (kernel->fn (buf + 2*n, m, NULL) != r
+                        || kernel->fn (buf + 2*n, m, out) != r
+                        || memcmp (out, expected, r) != 0)
+                        break;
+                }
+                if (n < 100 && n < units)
+                {
+                    fprintf (stderr, "utf8: %s kernel gives wrong result\n",
+                             kernel->name);
+                    errors++;
+                    continue;
+                }
+
+                start = now ();
+                for (i = 0; i < iterations; i++)
+                {
+                    size_t done = 0;
+                    /* what unicode_to_utf8 does, minus the scalar part */
+                    while (done < units)
+                    {
+                        done += kernel->fn (buf + 2*done, units - done,
+                                            out + done) + 1;
+                    }
+                    sink += done;
+                }
+                report (what, kernel->name, sizes[s], iterations,
+                        now () - start);
+            }
+
+            {
+                /* there are no surrogates for the two to differ on */
+                unsigned char *utf8 = unicode_to_utf8 (units * 2, buf, NULL);
+                unsigned char *scalar = scalar_to_utf8 (units * 2, buf);
+                if (strcmp ((char*)utf8, (char*)scalar) != 0)
+                {
+                    fprintf (stderr, "utf8: conversion gives wrong result\n");
+                    errors++;
+                }
+                free (scalar);
+                free (utf8);
+            }
+
+            {
+                volatile size_t sink = 0;
+                double start = now ();
+                size_t i;
+
+                for (i = 0; i < iterations; i++)
+                {
+                    unsigned char *utf8 = unicode_to_utf8 (units * 2, buf, NULL);
+                    sink += utf8[0];
+                    free (utf8);
+                }
+                report (what, "total", sizes[s], iterations,
+                        now () - start);
+            }
+
+            {
+                volatile size_t sink = 0;
+                double start = now ();
+                size_t i;
+
+                for (i = 0; i < iterations; i++)
+                {
+                    unsigned char *utf8 = scalar_to_utf8 (units * 2, buf);
+                    sink += utf8[0];
+                    free (utf8);
+                }
+                report (what, "scalar", sizes[s], iterations,
+                        now () - start);
+            }
+            free (expected);
+            free (out);
+            free (buf);
+        }
+    }
+    return errors;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int errors = 0;
+
+    errors += bench_checksum ();
+    errors += bench_crc ();
+    errors += bench_unicode ();
+
+    return (errors ? 1 : 0);
+}
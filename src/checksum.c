@@ -0,0 +1,206 @@
+/*
+ * checksum.c -- TNEF attribute checksums
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       The checksum of an attribute is the sum of its bytes modulo
+ *       65536.  Since 65536 divides the range of every accumulator used
+ *       below, each kernel may add in whatever order and width is
+ *       convenient and still give exactly the same result as adding
+ *       one byte at a time.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#if HAVE_STDINT_H
+#  include <stdint.h>
+#endif
+
+#if HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif
+
+#include "checksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && HAVE_IMMINTRIN_H
+#  include <immintrin.h>
+#  define CHECKSUM_X86 1
+#endif
+
+/* reference implementation */
+static uint16
+checksum16_byte (uint16 sum, const unsigned char *buf, size_t len)
+{
+    size_t i;
+    uint32 s = sum;
+
+    for (i = 0; i < len; i++)
+    {
+        s = ( s + (uint8)buf[i] ) & 0xffff;
+    }
+    return (uint16)s;
+}
+
+/* Portable version adding 8 bytes at a time.  The even and odd bytes of
+   each word are added into four 16 bit lanes of a 64 bit accumulator,
+   which is folded into the total before any lane can overflow. */
+static uint16
+checksum16_word (uint16 sum, const unsigned char *buf, size_t len)
+{
+    static const uint64_t lo_bytes = 0x00ff00ff00ff00ffULL;
+    static const uint64_t lo_words = 0x0000ffff0000ffffULL;
+    uint32 total = sum;
+
+    while (len >= 8)
+    {
+        size_t blocks = len / 8;
+        uint64_t acc = 0;
+
+        /* each block adds at most 2*255 to a lane */
+        if (blocks > 128) blocks = 128;
+        len -= blocks * 8;
+
+        while (blocks--)
+        {
+            uint64_t w;
+            memcpy (&w, buf, sizeof (w));
+            acc += (w & lo_bytes) + ((w >> 8) & lo_bytes);
+            buf += 8;
+        }
+        acc = (acc & lo_words) + ((acc >> 16) & lo_words);
+        total += (uint32)(acc & 0xffffffff) + (uint32)(acc >> 32);
+    }
+    return checksum16_byte ((uint16)(total & 0xffff), buf, len);
+}
+
+static int
+always_usable (void)
+{
+    return 1;
+}
+
+#if CHECKSUM_X86
+
+/* _mm_sad_epu8 against zero sums each group of 8 bytes into a 64 bit
+   lane, so the accumulators cannot overflow for any real length */
+
+__attribute__((target("sse2")))
+static uint16
+checksum16_sse2 (uint16 sum, const unsigned char *buf, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero;
+    uint64_t lanes[2];
+
+    while (len >= 32)
+    {
+        __m128i a = _mm_loadu_si128 ((const __m128i*)buf);
+        __m128i b = _mm_loadu_si128 ((const __m128i*)(buf + 16));
+        acc0 = _mm_add_epi64 (acc0, _mm_sad_epu8 (a, zero));
+        acc1 = _mm_add_epi64 (acc1, _mm_sad_epu8 (b, zero));
+        buf += 32;
+        len -= 32;
+    }
+    _mm_storeu_si128 ((__m128i*)lanes, _mm_add_epi64 (acc0, acc1));
+    sum = (uint16)((sum + lanes[0] + lanes[1]) & 0xffff);
+    return checksum16_word (sum, buf, len);
+}
+
+__attribute__((target("avx2")))
+static uint16
+checksum16_avx2 (uint16 sum, const unsigned char *buf, size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero;
+    uint64_t lanes[4];
+
+    while (len >= 64)
+    {
+        __m256i a = _mm256_loadu_si256 ((const __m256i*)buf);
+        __m256i b = _mm256_loadu_si256 ((const __m256i*)(buf + 32));
+        acc0 = _mm256_add_epi64 (acc0, _mm256_sad_epu8 (a, zero));
+        acc1 = _mm256_add_epi64 (acc1, _mm256_sad_epu8 (b, zero));
+        buf += 64;
+        len -= 64;
+    }
+    _mm256_storeu_si256 ((__m256i*)lanes, _mm256_add_epi64 (acc0, acc1));
+    sum = (uint16)((sum + lanes[0] + lanes[1] + lanes[2] + lanes[3])
+                   & 0xffff);
+    /* avoid the AVX to SSE transition penalty in the scalar tail */
+    _mm256_zeroupper ();
+    return checksum16_word (sum, buf, len);
+}
+
+static int
+sse2_usable (void)
+{
+    return __builtin_cpu_supports ("sse2");
+}
+
+static int
+avx2_usable (void)
+{
+    return __builtin_cpu_supports ("avx2");
+}
+
+#endif /* CHECKSUM_X86 */
+
+/* slowest first; checksum16 uses the last usable one */
+const Checksum_Kernel checksum_kernels[] =
+{
+    { "byte", checksum16_byte, always_usable },
+    { "word", checksum16_word, always_usable },
+#if CHECKSUM_X86
+    { "sse2", checksum16_sse2, sse2_usable },
+    { "avx2", checksum16_avx2, avx2_usable },
+#endif /* CHECKSUM_X86 */
+    { NULL, NULL, NULL }
+};
+
+static checksum16_fn best = NULL;
+
+static void
+pick_kernel (void)
+{
+    int i;
+
+    for (i = 0; checksum_kernels[i].name; i++)
+    {
+        if (checksum_kernels[i].usable ()) best = checksum_kernels[i].fn;
+    }
+}
+
+/* the choice is made once for all threads */
+#if HAVE_PTHREAD_H
+static pthread_once_t pick_once = PTHREAD_ONCE_INIT;
+#  define PICK_KERNEL() pthread_once (&pick_once, pick_kernel)
+#else
+#  define PICK_KERNEL() do { if (best == NULL) pick_kernel (); } while (0)
+#endif /* HAVE_PTHREAD_H */
+
+uint16
+checksum16 (uint16 sum, const unsigned char *buf, size_t len)
+{
+    PICK_KERNEL ();
+    return best (sum, buf, len);
+}
@@ -0,0 +1,48 @@
+/*
+ * checksum.h -- TNEF attribute checksums
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+typedef uint16 (*checksum16_fn) (uint16 sum,
+                                 const unsigned char *buf, size_t len);
+
+/* An implementation of the checksum, see checksum_kernels */
+typedef struct
+{
+    const char *name;
+    checksum16_fn fn;
+    int (*usable) (void);       /* can it run on this CPU? */
+} Checksum_Kernel;
+
+/* all implementations, terminated by an entry with a NULL name */
+extern const Checksum_Kernel checksum_kernels[];
+
+/* adds the bytes of buf to sum, modulo 65536, using the fastest kernel */
+extern uint16 checksum16 (uint16 sum, const unsigned char *buf, size_t len);
+
+#endif /* CHECKSUM_H */
@@ -67,6 +67,13 @@ extern void *memmove (void *, const void*, size_t)
 
 extern char* xstrdup (const char* str);
 
+/* for what every thread in batch mode needs its own copy of */
+#if HAVE_TLS
+#  define THREAD_LOCAL __thread
+#else
+#  define THREAD_LOCAL
+#endif
+
 /* ********** SIZES ********** */
 
 /*
@@ -0,0 +1,49 @@
+/*
+ * crc.h -- CRC32 as used by compressed RTF
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef CRC_H
+#define CRC_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+typedef uint32 (*crc32_fn) (uint32 crc, const unsigned char *buf, size_t len);
+
+/* An implementation of the CRC, see crc32_kernels */
+typedef struct
+{
+    const char *name;
+    crc32_fn fn;
+    int (*usable) (void);       /* can it run on this CPU? */
+} Crc_Kernel;
+
+/* all implementations, terminated by an entry with a NULL name */
+extern const Crc_Kernel crc32_kernels[];
+
+/* Feeds buf through the CRC whose current value is crc, using the
+   fastest kernel.  There is no pre or post conditioning, [MS-OXRTFCP]
+   starts with a CRC of 0 and uses the result as is. */
+extern uint32 crc32_update (uint32 crc, const unsigned char *buf, size_t len);
+
+#endif /* CRC_H */
@@ -40,14 +40,13 @@ dow_str(int dow)
 }
 
 const char *
-date_to_str (struct date *dt)
+date_to_str (const struct date *dt, char *buf)
 {
-    static char buf[32];
-    snprintf (buf, sizeof(buf), "%s %04d/%02d/%02d %02d:%02d:%02d",
+    snprintf (buf, DATE_STR_SIZE, "%s %04d/%02d/%02d %02d:%02d:%02d",
              dow_str(dt->dow),
              dt->year, dt->month, dt->day,
              dt->hour, dt->min, dt->sec);
-    buf[sizeof(buf)-1] = '\0';
+    buf[DATE_STR_SIZE-1] = '\0';
     return buf;
 }
 
@@ -36,7 +36,10 @@ struct date
     uint16 dow;
 };
 
-extern const char *date_to_str (struct date* dt);
+/* big enough for anything date_to_str writes */
+#define DATE_STR_SIZE 40
+
+extern const char *date_to_str (const struct date* dt, char *buf);
 extern void date_read (struct date *dt, const unsigned char *buf);
 
 #endif /* DATE_H */
@@ -30,9 +30,9 @@
 
 /* print message only when debug on */
 void
-debug_print (const char *fmt, ...)
+debug_print (TNEF_Context *ctx, const char *fmt, ...)
 {
-    if (DEBUG_ON)
+    if (DEBUG_ON(ctx))
     {
         va_list args;
         va_start (args, fmt);
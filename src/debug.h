@@ -26,6 +26,8 @@
 #  include "config.h"
 #endif /* HAVE_CONFIG_H */
 
-extern void debug_print (const char *fmt, ...);
+#include "options.h"
+
+extern void debug_print (TNEF_Context *ctx, const char *fmt, ...);
 
 #endif /* DEBUG_H */
@@ -25,21 +25,38 @@
 
 #include "common.h"
 
+#include <errno.h>
+#if HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
 #include "alloc.h"
+#include "async.h"
+#include "attr.h"
+#include "checksum.h"
 #include "date.h"
 #include "debug.h"
 #include "file.h"
+#include "manifest.h"
 #include "mapi_attr.h"
 #include "options.h"
+#include "output.h"
 #include "path.h"
+#include "store.h"
+#include "tar.h"
+#include "util.h"
 
 #define TNEF_DEFAULT_FILENAME "tnef-tmp"
+#define STREAM_CHUNK_SIZE 65536
 
 /* ask user for confirmation of the action */
 static int
-confirm_action (const char *prompt, ...)
+confirm_action (TNEF_Context *ctx, const char *prompt, ...)
 {
-    if (INTERACTIVE)
+    if (INTERACTIVE(ctx))
     {
         int confirmed = 0;
         char buf[BUFSIZ + 1];
@@ -57,10 +74,111 @@ confirm_action (const char *prompt, ...)
     return 1;
 }
 
+/* copies the file at from to a new file at name in the output */
+static int
+copy_file (TNEF_Context *ctx, const char *from, const char *name)
+{
+    unsigned char buf[STREAM_CHUNK_SIZE];
+    FILE *in = fopen (from, "rb");
+    FILE *out = in ? output_fopen (ctx->output, name) : NULL;
+    struct stat statbuf;
+    size_t n;
+    int ret = 0;
+
+    if (out == NULL)
+    {
+        if (in) fclose (in);
+        return -1;
+    }
+    if (fstat (fileno (in), &statbuf) == 0
+        && (off_t)(size_t)statbuf.st_size == statbuf.st_size)
+    {
+        /* in the kernel as far as it goes, the rest below */
+        n = output_copy_range (fileno (out), fileno (in), 0,
+                               (size_t)statbuf.st_size);
+        if (n > 0 && fseek (in, (long)n, SEEK_SET) != 0) ret = -1;
+    }
+    while (ret == 0 && (n = fread (buf, 1, sizeof (buf), in)) > 0)
+    {
+        if (fwrite (buf, 1, n, out) != n) ret = -1;
+    }
+    if (ferror (in)) ret = -1;
+    fclose (in);
+    if (fclose (out) != 0) ret = -1;
+    return ret;
+}
+
+/* Puts the data of file in the store, unless it is there already, and
+   makes name in the output (path in full) a link to it, or a copy where
+   links cannot be made, replacing name if replace is set.  Returns 0 if
+   the data has to be written to name as usual instead. */
+static int
+file_store (TNEF_Context *ctx, File *file, const char *name,
+            const char *path, int replace)
+{
+    char *object;
+
+    if (!file->hashed)
+    {
+        file->hash = xxh64 (file->data, file->len, 0);
+        file->hashed = 1;
+    }
+    object = store_put (ctx->store, file->hash, file->len,
+                        (file->tmp_path ? NULL : file->data), file->tmp_path);
+    if (object == NULL)
+    {
+        fprintf (stderr,
+                 "WARNING: %s: different data of the same hash is stored, "
+                 "not storing it\n", path);
+        file->hashed = 0;
+        return 0;
+    }
+    XFREE (file->tmp_path);     /* it has become the object */
+
+    debug_print (ctx, "Linking %s to %s\n", path, object);
+    if (replace) output_unlink (ctx->output, name);
+    if (output_link (ctx->output, object, name) != 0
+        && ((errno != EXDEV && errno != EPERM && errno != EMLINK)
+            || copy_file (ctx, object, name) != 0))
+    {
+        perror (path);
+        XFREE (object);
+        tnef_exit (1);
+    }
+    XFREE (object);
+    return 1;
+}
+
+/* Waits for the files given to the --async-write writer, giving up if
+   any of them could not be written */
 void
-file_write (File *file, const char* directory)
+file_write_finish (TNEF_Context *ctx)
+{
+    if (ctx->writes && async_wait (ctx->async, &ctx->writes) != 0)
+        tnef_exit (1);
+}
+
+/* the directory files are written to, opened the first time */
+static Output_Dir*
+output_dir (TNEF_Context *ctx, const char *directory)
+{
+    if (ctx->output == NULL)
+    {
+        ctx->output = output_open (directory);
+        if (ctx->output == NULL)
+        {
+            perror (directory);
+            tnef_exit (1);
+        }
+    }
+    return ctx->output;
+}
+
+void
+file_write (TNEF_Context *ctx, File *file, const char* directory)
 {
     char *path = NULL;
+    int claimed = 0;            /* name was created by find_free_number */
 
     assert (file);
     if (!file) return;
@@ -68,17 +186,17 @@ file_write (File *file, const char* directory)
     if (file->name == NULL)
     {
         file->name = strdup( TNEF_DEFAULT_FILENAME );
-        debug_print ("No file name specified, using default %s.\n", TNEF_DEFAULT_FILENAME);
+        debug_print (ctx, "No file name specified, using default %s.\n", TNEF_DEFAULT_FILENAME);
     }
 
     if ( file->path == NULL )
     {
-        file->path = munge_fname( file->name );
+        file->path = munge_fname( ctx, file->name );
 
         if (file->path == NULL)
         {
             file->path = strdup( TNEF_DEFAULT_FILENAME );
-            debug_print ("No path name available, using default %s.\n", TNEF_DEFAULT_FILENAME);
+            debug_print (ctx, "No path name available, using default %s.\n", TNEF_DEFAULT_FILENAME);
         }
     }
 
@@ -87,58 +205,130 @@ file_write (File *file, const char* directory)
     if (path == NULL)
     {
         path = strdup( TNEF_DEFAULT_FILENAME );
-        debug_print ("No path generated, using default %s.\n", TNEF_DEFAULT_FILENAME);
+        debug_print (ctx, "No path generated, using default %s.\n", TNEF_DEFAULT_FILENAME);
     }
 
-    debug_print ("%sWRITING\t|\t%s\t|\t%s\n",
-                 ((LIST_ONLY==0)?"":"NOT "), file->name, path);
+    debug_print (ctx, "%sWRITING\t|\t%s\t|\t%s\n",
+                 ((LIST_ONLY(ctx)==0)?"":"NOT "), file->name, path);
 
-    if (!LIST_ONLY)
+    if (ctx->tar && !LIST_ONLY(ctx))
+    {
+        /* nothing is streamed out when writing a tar, see tnef.c */
+        assert (file->tmp_path == NULL);
+        tar_add (ctx->tar, path, file->data, file->len, &file->dt);
+    }
+    else if (!LIST_ONLY(ctx))
     {
         FILE *fp = NULL;
+        char *name;             /* path, relative to directory */
+        Output_Dir *out;
 
-        if (!confirm_action ("extract %s?", file->name)) return;
-        if (!OVERWRITE_FILES)
+        if (!confirm_action (ctx, "extract %s?", file->name)) return;
+        out = output_dir (ctx, directory);
+        name = xstrdup (file->path);
+        if (async_pending (ctx->writes, path))
         {
-            if (file_exists (path))
+            /* the same name again, let the first land before looking */
+            file_write_finish (ctx);
+        }
+        if (!OVERWRITE_FILES(ctx))
+        {
+            if (output_exists (out, name))
             {
-                if (!NUMBER_FILES)
+                if (!NUMBER_FILES(ctx))
                 {
                     fprintf (stderr,
                              "tnef: %s: Could not create file: File exists\n",
                              path);
+                    XFREE (name);
+                    XFREE (path);
                     return;
                 }
                 else
                 {
-                    char *tmp = find_free_number (path);
-                    debug_print ("Renaming %s to %s\n", path, tmp);
+                    char *tmp = find_free_number (ctx, name);
+                    XFREE (name);
+                    name = tmp;
+                    tmp = concat_fname (directory, name);
+                    debug_print (ctx, "Renaming %s to %s\n", path, tmp);
                     XFREE (path);
                     path = tmp;
+                    claimed = 1;
                 }
             }
         }
 
-        fp = fopen (path, "wb");
-        if (fp == NULL)
+        if (ctx->store
+            && file_store (ctx, file, name, path,
+                           (OVERWRITE_FILES(ctx) || claimed)))
+        {
+            /* it is a link to the copy in the store */
+        }
+        else if (file->tmp_path)
+        {
+            /* the data was streamed out already, just give it a name */
+            if (output_rename (out, file->tmp_path, name) != 0)
+            {
+                perror (path);
+                tnef_exit (1);
+            }
+            XFREE (file->tmp_path);
+        }
+        else if (ctx->async)
         {
-            perror (path);
-            exit (1);
+            /* created here, so that it is there for the next file to
+               see, and written in the background */
+            int fd = output_create (out, name);
+            if (fd == -1)
+            {
+                perror (path);
+                tnef_exit (1);
+            }
+            async_write (ctx->async, &ctx->writes, fd, path, file);
         }
-        if (fwrite (file->data, 1, file->len, fp) != file->len)
+        else
         {
-            perror (path);
-            exit (1);
+            size_t done = 0;
+
+            fp = output_fopen (out, name);
+            if (fp == NULL)
+            {
+                perror (path);
+                tnef_exit (1);
+            }
+            if (file->in_file)
+            {
+                /* what the kernel cannot copy is written as usual */
+                done = output_copy_range (fileno (fp), file->in_fd,
+                                          file->in_offset, file->len);
+            }
+            if (fwrite (file->data + done, 1, file->len - done, fp)
+                != file->len - done)
+            {
+                perror (path);
+                fclose (fp);
+                tnef_exit (1);
+            }
+            fclose (fp);
         }
-        fclose (fp);
+        XFREE (name);
     }
 
-    if (LIST_ONLY || VERBOSE_ON)
+    if (JSON_OUT(ctx))
+    {
+        manifest_file (ctx, file, path);
+    }
+    else if (LIST_ONLY(ctx) || VERBOSE_ON(ctx))
     {
-        if (LIST_ONLY && VERBOSE_ON)
+#if HAVE_FLOCKFILE
+        /* keep the line whole when several files are done at once */
+        flockfile (stdout);
+#endif
+        if (LIST_ONLY(ctx) && VERBOSE_ON(ctx))
         {
             /* FIXME: print out date and stuff */
-            const char *date_str = date_to_str(&file->dt);
+            char date_buf[DATE_STR_SIZE];
+            const char *date_str = date_to_str(&file->dt, date_buf);
             fprintf (stdout, "%11lu\t|\t%s\t|\t%s\t|\t%s",
                      (unsigned long)file->len,
                      date_str+4, /* skip the day of week */
@@ -149,23 +339,72 @@ file_write (File *file, const char* directory)
         {
             fprintf (stdout, "%s\t|\t%s", file->name, path);
         }
-        if ( SHOW_MIME )
+        if ( SHOW_MIME(ctx) )
         {
             fprintf (stdout, "\t|\t%s", file->mime_type ? file->mime_type : "unknown");
             fprintf (stdout, "\t|\t%s", file->content_id ? file->content_id : "");
         }
         fprintf (stdout, "\n");
+#if HAVE_FLOCKFILE
+        funlockfile (stdout);
+#endif
     }
     XFREE(path);
 }
 
+/* remove the temporary file holding streamed data, if any */
 static void
-file_add_mapi_attrs (File* file, MAPI_Attr** attrs)
+file_discard_tmp (File* file)
 {
-    int i;
-    for (i = 0; attrs[i]; i++)
+    if (file->tmp_fp)
+    {
+        fclose (file->tmp_fp);
+        file->tmp_fp = NULL;
+    }
+    if (file->tmp_path)
     {
-        MAPI_Attr* a = attrs[i];
+        unlink (file->tmp_path);
+        XFREE (file->tmp_path);
+    }
+}
+
+/* Replace the data of file.  If borrowed is set data belongs to someone
+   else and will not be freed with file. */
+static void
+file_set_data (File* file, unsigned char *data, size_t len, int borrowed)
+{
+    file_discard_tmp (file);
+    if (!file->borrowed) XFREE (file->data);
+    file->data = data;
+    file->len = len;
+    file->borrowed = borrowed;
+    file->hashed = 0;
+    file->in_file = 0;
+}
+
+/* borrowed indicates that index was read from the input mapping so
+   its binary values may be kept past the lifetime of index.  Only the
+   properties wanted here are decoded. */
+void
+file_add_mapi_attrs (TNEF_Context *ctx, File* file, MAPI_Index *index,
+                     int borrowed)
+{
+    size_t i;
+    for (i = 0; i < index->num_props; i++)
+    {
+        MAPI_Attr* a;
+
+        switch (index->props[i].name)
+        {
+        case MAPI_ATTACH_LONG_FILENAME:
+        case MAPI_ATTACH_DATA_OBJ:
+        case MAPI_ATTACH_MIME_TAG:
+        case MAPI_ATTACH_CONTENT_ID:
+            a = mapi_index_decode (ctx, index, &index->props[i]);
+            break;
+        default:
+            continue;
+        }
 
         if (a->num_values)
         {
@@ -173,31 +412,41 @@ file_add_mapi_attrs (File* file, MAPI_Attr** attrs)
             switch (a->name)
             {
             case MAPI_ATTACH_LONG_FILENAME:
-                assert(a->type == szMAPI_STRING || a->type == szMAPI_UNICODE_STRING);
+                CHECKINPUT(a->type == szMAPI_STRING || a->type == szMAPI_UNICODE_STRING);
                 if (file->name) XFREE(file->name);
                 file->name = strdup( (char*)a->values[0].data.buf );
                 break;
 
             case MAPI_ATTACH_DATA_OBJ:
-                assert((a->type == szMAPI_BINARY) || (a->type == szMAPI_OBJECT));
-                file->len = a->values[0].len;
-                if (file->data) XFREE (file->data);
-                file->data = CHECKED_XMALLOC (unsigned char, file->len);
-                memmove (file->data, a->values[0].data.buf, file->len);
+                CHECKINPUT((a->type == szMAPI_BINARY) || (a->type == szMAPI_OBJECT));
+                if (borrowed)
+                {
+                    file_set_data (file, a->values[0].data.buf,
+                                   a->values[0].len, 1);
+                }
+                else
+                {
+                    unsigned char *data
+                        = CHECKED_XMALLOC (unsigned char, a->values[0].len);
+                    memmove (data, a->values[0].data.buf, a->values[0].len);
+                    file_set_data (file, data, a->values[0].len, 0);
+                }
                 break;
 
              case MAPI_ATTACH_MIME_TAG:
-                assert(a->type == szMAPI_STRING || a->type == szMAPI_UNICODE_STRING);
+                CHECKINPUT(a->type == szMAPI_STRING || a->type == szMAPI_UNICODE_STRING);
                 if (file->mime_type) XFREE (file->mime_type);
-                file->mime_type = CHECKED_XMALLOC (char, a->values[0].len);
+                file->mime_type = CHECKED_XMALLOC_ADDNULL (char, a->values[0].len);
                 memmove (file->mime_type, a->values[0].data.buf, a->values[0].len);
+                file->mime_type[a->values[0].len] = '\0';
                 break;
 
             case MAPI_ATTACH_CONTENT_ID:
-                assert(a->type == szMAPI_STRING || a->type == szMAPI_UNICODE_STRING);
+                CHECKINPUT(a->type == szMAPI_STRING || a->type == szMAPI_UNICODE_STRING);
                 if (file->content_id) XFREE(file->content_id);
-                file->content_id = CHECKED_XMALLOC (char, a->values[0].len);
+                file->content_id = CHECKED_XMALLOC_ADDNULL (char, a->values[0].len);
                 memmove (file->content_id, a->values[0].data.buf, a->values[0].len);
+                file->content_id[a->values[0].len] = '\0';
                 break;
 
             default:
@@ -220,26 +469,15 @@ file_add_attr (File* file, Attr* attr)
         copy_date_from_attr (attr, &file->dt);
         break;
 
-    case attATTACHMENT:
-    {
-        MAPI_Attr **mapi_attrs = mapi_attr_read (attr->len, attr->buf);
-        if (mapi_attrs)
-        {
-            file_add_mapi_attrs (file, mapi_attrs);
-            mapi_attr_free_list (mapi_attrs);
-            XFREE (mapi_attrs);
-        }
-    }
-    break;
-
     case attATTACHTITLE:
         file->name = strdup( (char*)attr->buf );
         break;
 
     case attATTACHDATA:
-        file->len = attr->len;
-        file->data = CHECKED_XMALLOC(unsigned char, attr->len);
-        memmove (file->data, attr->buf, attr->len);
+        /* take the data over from attr rather than copying it */
+        file_set_data (file, attr->buf, attr->len, attr->borrowed);
+        attr->buf = NULL;
+        attr->borrowed = 0;
         break;
 
     default:
@@ -247,13 +485,130 @@ file_add_attr (File* file, Attr* attr)
     }
 }
 
+/* Moves past the data of attr, whose header has just been read, and its
+   checksum, only noting the length.  Used when listing. */
+void
+file_skip_data (File *file, Input *in, Attr *attr)
+{
+    assert (file && attr);
+
+    /* as if the data had been read */
+    alloc_limit_assert ("file_skip_data", attr->len);
+
+    file_set_data (file, NULL, attr->len, 0);
+    input_skip (in, attr->len + 2);
+}
+
+/* creates a new, uniquely named, file in directory to stream data into */
+static FILE*
+open_tmp_file (const char* directory, char **tmp_path)
+{
+    static THREAD_LOCAL unsigned int counter = 0;
+    char name[64];
+    int fd;
+    FILE *fp;
+
+    do
+    {
+        sprintf (name, ".tnef-%ld-%u", (long)getpid(), counter++);
+        XFREE (*tmp_path);
+        *tmp_path = concat_fname (directory, name);
+        fd = open (*tmp_path, O_WRONLY|O_CREAT|O_EXCL, 0666);
+    }
+    while (fd < 0 && errno == EEXIST);
+
+    if (fd < 0 || (fp = fdopen (fd, "wb")) == NULL)
+    {
+        perror (*tmp_path);
+        tnef_exit (1);
+    }
+    return fp;
+}
+
+/* Copies the data of attr, whose header has just been read, from the
+   input into a temporary file in fixed size chunks so that large
+   attachments are never held in memory.  The checksum is computed on
+   the way and the temporary file is removed if it does not match.
+   file_write later moves the file to its final name. */
+void
+file_stream_data (TNEF_Context *ctx, File *file, Input *in, Attr *attr,
+                  const char* directory)
+{
+    unsigned char buf[STREAM_CHUNK_SIZE];
+    size_t left = attr->len;
+    uint16 sum = 0;
+    FILE *fp = NULL;
+    XXH64_State hash;
+
+    assert (file && attr);
+
+    /* nothing is allocated but --maxsize still applies */
+    alloc_limit_assert ("file_stream_data", attr->len);
+
+    file_set_data (file, NULL, attr->len, 0);
+    if (!LIST_ONLY(ctx))
+    {
+        /* so that it can become the copy in the store as it is */
+        if (ctx->store) directory = store_dir (ctx->store);
+        fp = file->tmp_fp = open_tmp_file (directory, &file->tmp_path);
+    }
+    if (ctx->store) xxh64_init (&hash, 0);
+
+    while (left > 0)
+    {
+        size_t n = (left < sizeof (buf)) ? left : sizeof (buf);
+
+        if (in->map)
+        {
+            memmove (buf, input_view (in, n), n);
+        }
+        else if (fread (buf, 1, n, in->fp) != n)
+        {
+            perror ("Unexpected end of input");
+            file_discard_tmp (file);
+            tnef_exit (1);
+        }
+        sum = checksum16 (sum, buf, n);
+        if (ctx->store) xxh64_update (&hash, buf, n);
+
+        if (fp && fwrite (buf, 1, n, fp) != n)
+        {
+            perror (file->tmp_path);
+            file_discard_tmp (file);
+            tnef_exit (1);
+        }
+        left -= n;
+    }
+
+    file->tmp_fp = NULL;
+    if (fp && fclose (fp) != 0)
+    {
+        perror (file->tmp_path);
+        file_discard_tmp (file);
+        tnef_exit (1);
+    }
+
+    if (fp && ctx->store)
+    {
+        file->hash = xxh64_digest (&hash);
+        file->hashed = 1;
+    }
+
+    if (geti16 (in) != sum)
+    {
+        if (!CHECKSUM_SKIP(ctx)) file_discard_tmp (file);
+        attr_checksum_failed (ctx);
+    }
+}
+
 void
 file_free (File *file)
 {
     if (file)
     {
+        file_discard_tmp (file);
         XFREE (file->name);
-        XFREE (file->data);
+        if (!file->borrowed) XFREE (file->data);
         XFREE (file->mime_type);
         XFREE (file->content_id);
         XFREE (file->path);
@@ -30,6 +30,12 @@
 
 #include "date.h"
 #include "attr.h"
+#include "mapi_attr.h"
+#include "options.h"
+#include "xxhash.h"
+
+/* how the data of a file stood up to its checksum */
+enum { DATA_UNCHECKED = 0, DATA_OK, DATA_CORRUPT };
 
 typedef struct
 {
@@ -37,12 +43,28 @@ typedef struct
     char * path;	/* filesystem "safe" version of name */
     size_t len;
     unsigned char * data;
+    int borrowed;       /* data is owned by someone else (eg. the input) */
     struct date dt;
     char * mime_type;
     char * content_id; /* cid for inline HTML attachments */
+    char * tmp_path;   /* data has already been streamed to this file */
+    FILE * tmp_fp;     /* tmp_path, while it is being written */
+    int checksum;      /* DATA_OK, ... */
+    char body_type;    /* 't', 'h' or 'r' for a message body */
+    int hashed;        /* hash is that of data, for --store */
+    uint64_t hash;
+    int in_file;       /* data is also in_offset bytes into in_fd */
+    int in_fd;
+    off_t in_offset;
 } File;
 
-extern void file_write (File *file, const char* directory);
+extern void file_write (TNEF_Context *ctx, File *file, const char* directory);
+extern void file_write_finish (TNEF_Context *ctx);
 extern void file_add_attr (File* file, Attr* attr);
+extern void file_add_mapi_attrs (TNEF_Context *ctx, File* file,
+                                 MAPI_Index *index, int borrowed);
+extern void file_skip_data (File *file, Input *in, Attr *attr);
+extern void file_stream_data (TNEF_Context *ctx, File *file, Input *in,
+                              Attr *attr, const char* directory);
 extern void file_free (File *file);
 #endif /* FILE_H */
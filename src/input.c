@@ -0,0 +1,225 @@
+/*
+ * input.c -- reading the TNEF stream from a file or a memory mapping
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       Regular files are mapped and walked with a cursor so that the
+ *       many small header fields are decoded straight from memory.
+ *       Anything that cannot be mapped (stdin from a pipe, ...) is
+ *       read through stdio as before.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include <limits.h>
+
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+#if HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
+
+#include "input.h"
+#include "util.h"
+
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+#  define USE_MMAP 1
+#endif
+
+/* prepare to read from fp, mapping it if possible */
+void
+input_open (Input *in, FILE *fp)
+{
+    memset (in, '\0', sizeof (Input));
+    in->fp = fp;
+
+#if USE_MMAP
+    {
+        struct stat statbuf;
+        long start = ftell (fp);
+
+        if (start >= 0
+            && fstat (fileno (fp), &statbuf) == 0
+            && S_ISREG (statbuf.st_mode)
+            && statbuf.st_size > start
+            && (off_t)(size_t)statbuf.st_size == statbuf.st_size)
+        {
+            void *map = mmap (NULL, (size_t)statbuf.st_size, PROT_READ,
+                              MAP_PRIVATE, fileno (fp), 0);
+            if (map != MAP_FAILED)
+            {
+#  ifdef MADV_SEQUENTIAL
+                (void)madvise (map, (size_t)statbuf.st_size, MADV_SEQUENTIAL);
+#  endif
+                in->map = (unsigned char*)map;
+                in->size = (size_t)statbuf.st_size;
+                in->pos = (size_t)start;
+            }
+        }
+    }
+#endif /* USE_MMAP */
+}
+
+/* prepare to read from len bytes at buf, which must not be empty and
+   must stay put until input_close */
+void
+input_open_buffer (Input *in, const void *buf, size_t len)
+{
+    assert (buf && len > 0);
+
+    memset (in, '\0', sizeof (Input));
+    in->map = (unsigned char*)buf;     /* never written through */
+    in->size = len;
+    in->borrowed = 1;
+}
+
+void
+input_close (Input *in)
+{
+#if USE_MMAP
+    if (in->map && !in->borrowed)
+    {
+        munmap (in->map, in->size);
+    }
+#endif /* USE_MMAP */
+    in->map = NULL;
+    in->size = in->pos = 0;
+}
+
+/* return the next byte without consuming it, or EOF */
+int
+input_peek (Input *in)
+{
+    int c;
+
+    if (in->map)
+    {
+        return (in->pos < in->size) ? in->map[in->pos] : EOF;
+    }
+
+    c = fgetc (in->fp);
+    if (c != EOF) ungetc (c, in->fp);
+    return c;
+}
+
+int
+input_at_eof (Input *in)
+{
+    if (in->map) return (in->pos >= in->size);
+    return feof (in->fp);
+}
+
+/* stores the number of unread bytes in *left.  Returns 0 when that
+   cannot be known (eg. reading from a pipe) */
+int
+input_remaining (Input *in, size_t *left)
+{
+    struct stat statbuf;
+    long pos;
+
+    if (in->map)
+    {
+        *left = in->size - in->pos;
+        return 1;
+    }
+
+    if (fstat (fileno (in->fp), &statbuf) != 0
+        || !S_ISREG (statbuf.st_mode))
+        return 0;
+
+    pos = ftell (in->fp);
+    if (pos < 0 || pos > statbuf.st_size) return 0;
+
+    *left = (size_t)(statbuf.st_size - pos);
+    return 1;
+}
+
+/* returns a pointer to the next n bytes of the mapping and moves the
+   cursor past them.  Only valid on mapped input */
+unsigned char*
+input_view (Input *in, size_t n)
+{
+    unsigned char *p;
+
+    assert (in->map);
+    if (n > in->size - in->pos)
+    {
+        fprintf (stderr, "Unexpected end of input\n");
+        tnef_exit (1);
+    }
+    p = in->map + in->pos;
+    in->pos += n;
+    return p;
+}
+
+/* Whether the len bytes at p are in the mapping of the input file, and
+   if so sets *fd and *offset to where they are in the file.  Never for
+   a buffer given to input_open_buffer. */
+int
+input_file_range (const Input *in, const void *p, size_t len,
+                  int *fd, off_t *offset)
+{
+    const unsigned char *q = (const unsigned char*)p;
+
+    if (in->map == NULL || in->borrowed || in->fp == NULL) return 0;
+    if (q < in->map || q > in->map + in->size
+        || len > (size_t)(in->map + in->size - q))
+        return 0;
+
+    *fd = fileno (in->fp);
+    *offset = (off_t)(q - in->map);
+    return 1;
+}
+
+/* moves past the next n bytes without looking at them */
+void
+input_skip (Input *in, size_t n)
+{
+    size_t left;
+
+    if (in->map)
+    {
+        (void)input_view (in, n);
+        return;
+    }
+
+    if (input_remaining (in, &left)
+        && n <= left
+        && n <= (size_t)LONG_MAX
+        && fseek (in->fp, (long)n, SEEK_CUR) == 0)
+        return;
+
+    /* a pipe, read and drop it */
+    while (n > 0)
+    {
+        unsigned char buf[BUFSIZ];
+        size_t chunk = (n < sizeof (buf)) ? n : sizeof (buf);
+
+        if (fread (buf, 1, chunk, in->fp) != chunk)
+        {
+            perror ("Unexpected end of input");
+            tnef_exit (1);
+        }
+        n -= chunk;
+    }
+}
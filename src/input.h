@@ -0,0 +1,55 @@
+/*
+ * input.h -- reading the TNEF stream from a file or a memory mapping
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef INPUT_H
+#define INPUT_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+/* Input -- the TNEF stream being parsed.  When the stream is a regular
+   file it is mapped into memory and read through a cursor, otherwise
+   (pipes, terminals, failed mappings) reads go through stdio.  A buffer
+   already in memory is read through the same cursor. */
+typedef struct
+{
+    FILE *fp;
+    unsigned char *map;         /* mapped file contents or NULL */
+    size_t size;                /* size of the mapping */
+    size_t pos;                 /* cursor into the mapping */
+    int borrowed;               /* map belongs to the caller */
+} Input;
+
+extern void input_open (Input *in, FILE *fp);
+extern void input_open_buffer (Input *in, const void *buf, size_t len);
+extern void input_close (Input *in);
+extern int input_peek (Input *in);
+extern int input_at_eof (Input *in);
+extern int input_remaining (Input *in, size_t *left);
+extern unsigned char* input_view (Input *in, size_t n);
+extern void input_skip (Input *in, size_t n);
+extern int input_file_range (const Input *in, const void *p, size_t len,
+                             int *fd, off_t *offset);
+
+#endif /* INPUT_H */
@@ -0,0 +1,73 @@
+/*
+ * libtnef.c -- decode TNEF held in memory
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       The entry points of libtnef.  Errors which would make the tnef
+ *       program exit unwind back to here through tnef_exit instead.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include "alloc.h"
+#include "libtnef.h"
+#include "options.h"
+#include "tnef.h"
+#include "util.h"
+
+int
+tnef_parse_buffer (const void *buf, size_t len,
+                   const TNEF_Callbacks *callbacks)
+{
+    static const TNEF_Callbacks no_callbacks;
+    TNEF_Context ctx;
+    jmp_buf point;
+    int ret;
+
+    /* the parser itself would complain about this on stdout */
+    if (buf == NULL || len < 4
+        || GETINT32 ((unsigned char*)buf) != TNEF_SIGNATURE)
+        return TNEF_NOT_TNEF;
+
+    context_init (&ctx, NONE, 0);
+    ctx.callbacks = callbacks ? callbacks : &no_callbacks;
+
+    if (setjmp (point) == 0)
+    {
+        set_exit_point (&point);
+        ret = (parse_buffer (&ctx, buf, len) == 0) ? TNEF_OK : TNEF_CORRUPT;
+    }
+    else
+    {
+        parse_file_abandon (&ctx);
+        ret = ctx.stopped ? TNEF_STOPPED : TNEF_CORRUPT;
+    }
+    set_exit_point (NULL);
+
+    return ret;
+}
+
+void
+tnef_thread_release (void)
+{
+    alloc_arena_release ();
+}
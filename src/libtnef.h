@@ -0,0 +1,144 @@
+/*
+ * libtnef.h -- decode TNEF held in memory
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       The installed interface of libtnef.  tnef_parse_buffer decodes
+ *       a TNEF stream (eg. a winmail.dat) that is already in memory and
+ *       hands what it finds to the callbacks as it goes.  Nothing is
+ *       read from or written to the filesystem.
+ *
+ *       For each attachment the callbacks see on_attachment_begin, then
+ *       on_attribute and on_mapi_property for what it is made of, with
+ *       on_attachment_data_chunk for its data, then on_attachment_end.
+ *       Message attributes and properties may come before, between and
+ *       after the attachments, the bodies come last.
+ */
+#ifndef LIBTNEF_H
+#define LIBTNEF_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A piece of memory owned by the library.  Only valid until the
+   callback it was passed to returns. */
+typedef struct
+{
+    const unsigned char *data;
+    size_t len;
+} TNEF_Span;
+
+/* As stored in the TNEF, all zero when it had none */
+typedef struct
+{
+    unsigned short year, month, day;
+    unsigned short hour, min, sec;
+} TNEF_Date;
+
+typedef enum
+{
+    TNEF_LEVEL_MESSAGE = 1,
+    TNEF_LEVEL_ATTACHMENT = 2
+} TNEF_Level;
+
+/* One TNEF attribute, names and types as in tnef-names.data and
+   tnef-types.data */
+typedef struct
+{
+    TNEF_Level level;
+    unsigned short name;
+    unsigned short type;
+    TNEF_Span data;
+} TNEF_Attribute;
+
+/* One MAPI property from the attMAPIPROPS (message) or attATTACHMENT
+   attribute, names and types as in mapi-names.data and
+   mapi-types.data.  Strings are UTF-8, their length not counting the
+   NUL which follows them.  Fixed size values are in host byte order. */
+typedef struct
+{
+    TNEF_Level level;
+    unsigned short name;
+    unsigned short type;        /* without the multi-value flag */
+    size_t num_values;
+    const TNEF_Span *values;
+    size_t num_names;           /* of a named property, UTF-8 */
+    const TNEF_Span *names;
+} TNEF_Property;
+
+typedef struct
+{
+    const char *name;           /* as given by the sender, or NULL */
+    const char *mime_type;      /* or NULL */
+    const char *content_id;     /* cid for inline HTML, or NULL */
+    TNEF_Date date;             /* last modified */
+    TNEF_Span data;
+} TNEF_Attachment;
+
+typedef enum
+{
+    TNEF_BODY_TEXT = 't',
+    TNEF_BODY_HTML = 'h',
+    TNEF_BODY_RTF = 'r'         /* already decompressed */
+} TNEF_Body_Type;
+
+/* Any callback may be NULL.  Returning non-zero from one stops the
+   parse, which then returns TNEF_STOPPED. */
+typedef struct
+{
+    void *user_data;            /* passed back to each callback */
+    int (*on_attribute) (void *user_data, const TNEF_Attribute *attr);
+    int (*on_mapi_property) (void *user_data, const TNEF_Property *prop);
+    int (*on_attachment_begin) (void *user_data);
+    /* The data of the attachment a piece at a time, before its checksum
+       has been verified.  Data held in a MAPI property comes in after
+       that property. */
+    int (*on_attachment_data_chunk) (void *user_data,
+                                     const TNEF_Span *chunk);
+    /* The attachment as a whole, its data included */
+    int (*on_attachment_end) (void *user_data, const TNEF_Attachment *att);
+    int (*on_body) (void *user_data, TNEF_Body_Type type,
+                    const TNEF_Span *body);
+} TNEF_Callbacks;
+
+enum
+{
+    TNEF_OK = 0,
+    TNEF_NOT_TNEF = 1,          /* no TNEF signature */
+    TNEF_CORRUPT = 2,           /* bad checksum, truncated, ... */
+    TNEF_STOPPED = 3            /* a callback returned non-zero */
+};
+
+/* Decodes the len bytes at buf, which are not modified.  Safe to call
+   from several threads at once. */
+extern int tnef_parse_buffer (const void *buf, size_t len,
+                              const TNEF_Callbacks *callbacks);
+
+/* Frees what the calling thread keeps from one tnef_parse_buffer to the
+   next.  A thread which has called it should call this before exiting. */
+extern void tnef_thread_release (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBTNEF_H */
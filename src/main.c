@@ -28,6 +28,10 @@
 #include "common.h"
 #include <ctype.h>
 
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
 #ifndef _
 /* This is for other GNU distributions with internationalized messages.
    When compiling libc, the _ macro is predefined.  */
@@ -46,8 +50,14 @@
 #endif /* HAVE_GETOPT_LONG */
 
 #include "alloc.h"
+#include "batch.h"
 #include "tnef.h"
 #include "options.h"
+#include "async.h"
+#include "mapi_names.h"
+#include "store.h"
+#include "tar.h"
+#include "util.h"
 
 /* COPYRIGHTS & NO_WARRANTY -- defined to make code below a little nicer to
    read */
@@ -62,6 +72,13 @@ static const char USAGE[] = \
 "-x SIZE --maxsize=SIZE  \tLimit maximum size of extracted archive (bytes)\n"
 "-t,     --list          \tList files, do not extract\n"
 "        --list-with-mime-types \tList files and mime-types, do not extract\n"
+"        --json          \tDescribe each file and message as a JSON\n"
+"                        \t  object on a line of its own\n"
+"        --props=TAG,... \tShow the MAPI properties TAG,... (such as\n"
+"                        \t  MAPI_SUBJECT) of each message as a JSON\n"
+"                        \t  object on a line of its own\n"
+"        --verify-checksums\tWhen listing, still read and check the data\n"
+"                        \t  of the files (it is skipped by default)\n"
 "-w,     --interactive   \tAsk for confirmation for every action\n"
 "        --confirmation  \t  same as -w\n"
 "        --overwrite     \tOverwrite existing files\n"
@@ -74,6 +91,17 @@ static const char USAGE[] = \
 "        --allow-absolute-paths\tAllow absolute paths (NOT RECOMMENDED)\n"
 "        --save-body[=FILE]\tSave the message body to a file\n"
 "        --body-pref=PREF\tPreferred body type (R|H|T|ALL)\n"
+"        --store=DIR     \tKeep the data of each distinct file once,\n"
+"                        \t  in DIR, and make the files links to it\n"
+"        --async-write   \tWrite the files in the background while\n"
+"                        \t  parsing goes on\n"
+"        --tar[=FILE]    \tWrite the files as a tar stream to FILE\n"
+"                        \t  (standard output if none or '-') instead\n"
+"                        \t  of creating them\n"
+"        --batch         \tExtract every FILE given (every file in a\n"
+"                        \t  directory, or every file listed on standard\n"
+"                        \t  input if there are none) into FILE.d\n"
+"-j N,   --jobs=N        \tIn batch mode extract N files at a time\n"
 "-h,     --help          \tShow this message\n"
 "-K,     --ignore-checksum\tIgnore any checksum error (warn only)\n"
 "        --ignore-encode \tIgnore any encoding error (warn only)\n"
@@ -81,6 +109,8 @@ static const char USAGE[] = \
 "-V,     --version       \tDisplay version and copyright\n"
 "-v,     --verbose       \tProduce verbose output\n"
 "        --debug     	 \tProduce a lot of output\n"
+"        --dump-limit=N  \tWith --debug, show only the first N bytes\n"
+"                        \t  of each binary value\n"
 "\n"
 "\nIf FILE is not specified standard input is used\n"
 "\nReport bugs to <%s>\n";
@@ -139,6 +169,59 @@ validate_body_pref (char *optarg)
 }
 
 
+/* The MAPI properties named in list, a comma separated list of names
+   from mapi-names.data, with or without their MAPI_, or numbers */
+static uint16*
+parse_props (const char *list, size_t *num_props)
+{
+    uint16 *props = XCALLOC (uint16, strlen (list) / 2 + 1);
+    char *copy = xstrdup (list);
+    char *tag;
+
+    *num_props = 0;
+    for (tag = strtok (copy, ","); tag; tag = strtok (NULL, ","))
+    {
+        char *end_ptr = NULL;
+        unsigned long n;
+        uint16 value;
+
+        if (mapi_name_from_str (tag, &value))
+        {
+            props[(*num_props)++] = value;
+            continue;
+        }
+        if (strncmp (tag, "MAPI_", 5) != 0)
+        {
+            char *name = XMALLOC (char, strlen (tag) + 6);
+            int found;
+            strcpy (name, "MAPI_");
+            strcat (name, tag);
+            found = mapi_name_from_str (name, &value);
+            XFREE (name);
+            if (found)
+            {
+                props[(*num_props)++] = value;
+                continue;
+            }
+        }
+        n = strtoul (tag, &end_ptr, 0);
+        if (*tag == '\0' || *end_ptr != '\0' || n > 0xffff)
+        {
+            fprintf (stderr, "Unknown MAPI property '%s' given to --props\n",
+                     tag);
+            exit (1);
+        }
+        props[(*num_props)++] = (uint16)n;
+    }
+    XFREE (copy);
+    if (*num_props == 0)
+    {
+        fprintf (stderr, "No MAPI properties given to --props\n");
+        exit (1);
+    }
+    return props;
+}
+
 static void
 parse_cmdline (int argc, char **argv,
                char **in_file,
@@ -146,14 +229,25 @@ parse_cmdline (int argc, char **argv,
                char **body_file,
                char **body_pref,
                size_t *max_size,
+               size_t *dump_limit,
+               char **tar_file,
+               char **store_dir,
+               uint16 **props,
+               size_t *num_props,
+               int *jobs,
+               char ***inputs,
+               int *num_inputs,
                int *flags)
 {
     int i = 0;
     int option_index = 0;
     static struct option long_options[] =
     {
+        {"async-write", no_argument, 0, 0},
+        {"batch", no_argument, 0, 0},
         {"confirmation", no_argument, 0, 'w' },
         {"debug", no_argument, 0, 0},
+        {"dump-limit", required_argument, 0, 0},
         {"directory", required_argument, 0, 'C' },
         {"file", required_argument, 0, 'f' },
         {"help", no_argument, 0, 'h'},
@@ -161,15 +255,21 @@ parse_cmdline (int argc, char **argv,
         {"ignore-encode", no_argument, 0, 0 },
         {"ignore-cruft", no_argument, 0, 0 },
         {"interactive", no_argument, 0, 'w' },
+        {"jobs", required_argument, 0, 'j' },
+        {"json", no_argument, 0, 0},
         {"list-with-mime-types", no_argument, 0, 0},
         {"list", no_argument, 0, 't'},
         {"maxsize", required_argument, 0, 'x' },
         {"number-backups", no_argument, 0, 0 },
         {"overwrite", no_argument, 0, 0 },
+        {"props", required_argument, 0, 0 },
         {"use-paths", no_argument, 0, 0},
+        {"verify-checksums", no_argument, 0, 0},
         {"unix-paths", no_argument, 0, 0},
         {"allow-absolute-paths", no_argument, 0, 0},
         {"save-body", optional_argument, 0, 0 },
+        {"store", required_argument, 0, 0 },
+        {"tar", optional_argument, 0, 0 },
         {"body-pref", required_argument, 0, 0 },
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
@@ -179,7 +279,7 @@ parse_cmdline (int argc, char **argv,
     /* default values */
     (*body_pref) = strdup("rht");
 
-    while ((i = getopt_long (argc, argv, "f:C:x:vVwhtK",
+    while ((i = getopt_long (argc, argv, "f:C:x:j:vVwhtK",
                              long_options, &option_index)) != -1)
     {
         switch (i)
@@ -190,6 +290,19 @@ parse_cmdline (int argc, char **argv,
             {
                 *flags |= DBG_OUT;
             }
+            else if (strcmp (long_options[option_index].name,
+                             "dump-limit") == 0)
+            {
+                char *end_ptr = NULL;
+                (*dump_limit) = strtoul (optarg, &end_ptr, 10);
+                if (*end_ptr != '\0')
+                {
+                    fprintf (stderr,
+                             "Invalid argument to --dump-limit option: '%s'\n",
+                             optarg);
+                    exit (-1);
+                }
+            }
             else if (strcmp (long_options[option_index].name,
                              "use-paths") == 0)
             {
@@ -242,6 +355,42 @@ parse_cmdline (int argc, char **argv,
             {
                 *flags |= CRUFT_OK;
             }
+            else if (strcmp (long_options[option_index].name,
+                             "verify-checksums") == 0)
+            {
+                *flags |= VERIFY;
+            }
+            else if (strcmp (long_options[option_index].name,
+                             "store") == 0)
+            {
+                (*store_dir) = optarg;
+            }
+            else if (strcmp (long_options[option_index].name,
+                             "tar") == 0)
+            {
+                (*tar_file) = (optarg) ? optarg : "-";
+            }
+            else if (strcmp (long_options[option_index].name,
+                             "json") == 0)
+            {
+                *flags |= JSON;
+            }
+            else if (strcmp (long_options[option_index].name,
+                             "props") == 0)
+            {
+                XFREE (*props);
+                (*props) = parse_props (optarg, num_props);
+            }
+            else if (strcmp (long_options[option_index].name,
+                             "async-write") == 0)
+            {
+                *flags |= ASYNC;
+            }
+            else if (strcmp (long_options[option_index].name,
+                             "batch") == 0)
+            {
+                *flags |= BATCH;
+            }
             else
             {
                 abort ();       /* impossible! */
@@ -291,6 +440,21 @@ parse_cmdline (int argc, char **argv,
             }
             break;
 
+        case 'j':
+            {
+                char *end_ptr = NULL;
+                long n = strtol (optarg, &end_ptr, 10);
+                if (*end_ptr != '\0' || n < 1 || n > 1024)
+                {
+                    fprintf (stderr,
+                             "Invalid argument to --jobs/-j option: '%s'\n",
+                             optarg);
+                    exit (1);
+                }
+                (*jobs) = (int)n;
+            }
+            break;
+
         case 'h':
             usage(argv[0]);
             exit (0);
@@ -317,7 +481,18 @@ parse_cmdline (int argc, char **argv,
             abort();            /* this is a problem */
         }
     }
-    if (optind < argc)
+    if (*flags & BATCH)
+    {
+        if (*in_file)
+        {
+            fprintf (stderr, "%s: --file cannot be used with --batch, "
+                     "give the files as arguments\n", argv[0]);
+            exit (1);
+        }
+        (*inputs) = argv + optind;
+        (*num_inputs) = argc - optind;
+    }
+    else if (optind < argc)
     {
         (*in_file) = argv[optind++];
         if (optind < argc)
@@ -339,22 +514,84 @@ main (int argc, char *argv[])
     char *out_dir = NULL;
     char *body_file = NULL;
     char *body_pref = NULL;
+    TNEF_Context ctx;
     int flags = NONE;
     size_t max_size = 0;
+    size_t dump_limit = 0;
+    char *tar_file = NULL;
+    char *store_dir = NULL;
+    uint16 *props = NULL;
+    size_t num_props = 0;
+    int jobs = 0;
+    char **inputs = NULL;
+    int num_inputs = 0;
 
     parse_cmdline (argc, argv,
                    &in_file, &out_dir,
                    &body_file, &body_pref,
-                   &max_size,
+                   &max_size, &dump_limit, &tar_file, &store_dir,
+                   &props, &num_props, &jobs, &inputs, &num_inputs,
                    &flags);
 
+    if (tar_file && store_dir)
+    {
+        fprintf (stderr, "Cannot use --tar and --store at the same time.\n");
+        exit (1);
+    }
+    if (tar_file && strcmp (tar_file, "-") == 0
+        && ((flags & (LIST|VERBOSE|DBG_OUT|JSON|CONFIRM)) || props))
+    {
+        fprintf (stderr,
+                 "Cannot write a tar stream to standard output and list, "
+                 "show verbose, debug or JSON output or ask for "
+                 "confirmation at the same time.\n");
+        exit (1);
+    }
+
+    context_init (&ctx, flags, max_size);
+    ctx.dump_limit = dump_limit;
+    ctx.source = in_file ? in_file : "-";
+    ctx.props = props;
+    ctx.num_props = num_props;
+    if (tar_file) ctx.tar = tar_open (tar_file);
+    if (store_dir && !(flags & LIST)) ctx.store = store_open (store_dir);
+    if ((flags & ASYNC) && !(flags & LIST) && !tar_file)
+        ctx.async = async_open ();
     set_alloc_limit (max_size);
-    if (flags & DBG_OUT)
+    if (DEBUG_ON(&ctx))
     {
         fprintf (stdout, "setting alloc_limit to: %lu\n",
                  (unsigned long)max_size);
     }
 
+    if (flags & BATCH)
+    {
+        int ret;
+
+        if (flags & CONFIRM)
+        {
+            fprintf (stderr,
+                     "Cannot use interactive mode in batch mode.\n");
+            exit (1);
+        }
+        if (jobs == 0)
+        {
+#if HAVE_UNISTD_H && defined(_SC_NPROCESSORS_ONLN)
+            jobs = (int)sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+            if (jobs < 1) jobs = 1;
+        }
+        ret = run_batch (inputs, num_inputs, out_dir, jobs,
+                         body_file, body_pref, &ctx);
+        if (ctx.tar && tar_close (ctx.tar) != 0) ret = 1;
+        if (ctx.store) store_close (ctx.store);
+        async_close (ctx.async);
+        XFREE(props);
+        XFREE(body_pref);
+        XFREE(body_file);
+        return ret;
+    }
+
     /* open the file */
     if (in_file)
     {
@@ -377,7 +614,25 @@ main (int argc, char *argv[])
                  "interactive mode at the same time.\n");
         exit (1);
     }
-    int ret = parse_file (fp, out_dir, body_file, body_pref, flags);
+    /* a parse given up on comes back here, to be cleaned up as in
+       --batch rather than exiting on the spot */
+    jmp_buf point;
+    int ret;
+    ret = setjmp (point);
+    if (ret == 0)
+    {
+        set_exit_point (&point);
+        ret = parse_file (&ctx, fp, out_dir, body_file, body_pref);
+    }
+    else
+    {
+        parse_file_abandon (&ctx);
+    }
+    set_exit_point (NULL);
+    if (ctx.tar && tar_close (ctx.tar) != 0) ret = 1;
+    if (ctx.store) store_close (ctx.store);
+    async_close (ctx.async);
+    XFREE(props);
     XFREE(body_pref);
     XFREE(body_file);
     fclose(fp);
@@ -0,0 +1,487 @@
+/*
+ * manifest.c -- describe what was found as JSON, one object a line
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       With --json every file written (or listed) and every message
+ *       parsed is described by one JSON object on a line of its own on
+ *       stdout, instead of the usual text.  Each object is formatted
+ *       into a Writer and handed to stdout whole, so that objects from
+ *       the jobs of --batch never mix, and stdout is only flushed when
+ *       its own buffer fills.
+ *
+ *       With --props each message is followed by one more object, of
+ *       the properties asked for.  Only those are decoded, from the
+ *       index of the message's MAPI properties.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include "manifest.h"
+#include "mapi_names.h"
+#include "write.h"
+
+/* the length of the UTF-8 sequence at s, of at most len bytes, or 0 if
+   it is not one */
+static size_t
+utf8_length (const unsigned char *s, size_t len)
+{
+    size_t n, i;
+    uint32 c;
+
+    if (s[0] < 0x80) return 1;
+    else if ((s[0] & 0xe0) == 0xc0) { n = 2; c = s[0] & 0x1f; }
+    else if ((s[0] & 0xf0) == 0xe0) { n = 3; c = s[0] & 0x0f; }
+    else if ((s[0] & 0xf8) == 0xf0) { n = 4; c = s[0] & 0x07; }
+    else return 0;
+
+    if (n > len) return 0;
+    for (i = 1; i < n; i++)
+    {
+        if ((s[i] & 0xc0) != 0x80) return 0;
+        c = (c << 6) | (s[i] & 0x3f);
+    }
+    /* no overlong forms, surrogates or values past unicode */
+    if ((n == 2 && c < 0x80) || (n == 3 && c < 0x800)
+        || (n == 4 && c < 0x10000) || (c >= 0xd800 && c <= 0xdfff)
+        || c > 0x10ffff)
+        return 0;
+    return n;
+}
+
+/* s as a JSON string.  Names in a TNEF are often in the codepage of
+   the sender rather than UTF-8, bytes which are not are taken to be
+   Latin-1 so that the output is always valid JSON. */
+static void
+write_json_string (Writer *w, const char *str)
+{
+    const unsigned char *s = (const unsigned char*)str;
+    size_t len;
+
+    if (str == NULL)
+    {
+        write_text (w, "null");
+        return;
+    }
+
+    len = strlen (str);
+    write_char (w, '"');
+    while (len > 0)
+    {
+        size_t n = utf8_length (s, len);
+
+        if (n > 1)
+        {
+            write_chars (w, (const char*)s, n);
+        }
+        else if (n == 0)
+        {
+            /* U+0080..U+00FF in UTF-8 */
+            write_char (w, (char)(0xc0 | (s[0] >> 6)));
+            write_char (w, (char)(0x80 | (s[0] & 0x3f)));
+            n = 1;
+        }
+        else if (*s == '"' || *s == '\\')
+        {
+            write_char (w, '\\');
+            write_char (w, (char)*s);
+        }
+        else if (*s < 0x20)
+        {
+            write_text (w, "\\u00");
+            write_hex (w, *s, 2);
+        }
+        else
+        {
+            write_char (w, (char)*s);
+        }
+        s += n;
+        len -= n;
+    }
+    write_char (w, '"');
+}
+
+static void
+write_json_key (Writer *w, const char *key)
+{
+    write_text (w, ",\"");
+    write_text (w, key);
+    write_text (w, "\":");
+}
+
+/* as ISO 8601, or null if the TNEF had no date */
+static void
+write_json_date (Writer *w, const struct date *dt)
+{
+    if (dt->year == 0 && dt->month == 0 && dt->day == 0)
+    {
+        write_text (w, "null");
+        return;
+    }
+    write_char (w, '"');
+    write_unsigned (w, dt->year);
+    write_char (w, '-');
+    if (dt->month < 10) write_char (w, '0');
+    write_unsigned (w, dt->month);
+    write_char (w, '-');
+    if (dt->day < 10) write_char (w, '0');
+    write_unsigned (w, dt->day);
+    write_char (w, 'T');
+    if (dt->hour < 10) write_char (w, '0');
+    write_unsigned (w, dt->hour);
+    write_char (w, ':');
+    if (dt->min < 10) write_char (w, '0');
+    write_unsigned (w, dt->min);
+    write_char (w, ':');
+    if (dt->sec < 10) write_char (w, '0');
+    write_unsigned (w, dt->sec);
+    write_char (w, '"');
+}
+
+/* Each object is one line, which the writer may hand to stdout in more
+   than one go when it is large, so stdout is kept locked until the end
+   of it lest the lines of other threads of --batch come in between.
+   Nothing between here and manifest_end may give up on the parse. */
+static void
+manifest_begin (TNEF_Context *ctx, Writer *w, const char *type)
+{
+#if HAVE_FLOCKFILE
+    flockfile (stdout);
+#endif
+    writer_open (w, stdout, 0);
+    write_text (w, "{\"type\":\"");
+    write_text (w, type);
+    write_char (w, '"');
+    write_json_key (w, "source");
+    write_json_string (w, ctx->source);
+}
+
+static void
+manifest_end (Writer *w)
+{
+    write_text (w, "}\n");
+    writer_drain (w);
+#if HAVE_FLOCKFILE
+    funlockfile (stdout);
+#endif
+}
+
+static const char *
+checksum_str (int checksum)
+{
+    switch (checksum)
+    {
+    case DATA_OK: return "ok";
+    case DATA_CORRUPT: return "failed";
+    default: return "unchecked";
+    }
+}
+
+static const char *
+body_type_str (char body_type)
+{
+    switch (body_type)
+    {
+    case 't': return "text";
+    case 'h': return "html";
+    case 'r': return "rtf";
+    default: return NULL;
+    }
+}
+
+/* file has been written to path, or would have been when listing */
+void
+manifest_file (TNEF_Context *ctx, File *file, const char *path)
+{
+    Writer w;
+
+    manifest_begin (ctx, &w, (file->body_type ? "body" : "attachment"));
+    if (file->body_type)
+    {
+        write_json_key (&w, "body_type");
+        write_json_string (&w, body_type_str (file->body_type));
+    }
+    write_json_key (&w, "name");
+    write_json_string (&w, file->name);
+    write_json_key (&w, "path");
+    write_json_string (&w, path);
+    write_json_key (&w, "written");
+    write_text (&w, (LIST_ONLY(ctx) ? "false" : "true"));
+    write_json_key (&w, "size");
+    write_unsigned (&w, (unsigned long)file->len);
+    write_json_key (&w, "date");
+    write_json_date (&w, &file->dt);
+    write_json_key (&w, "mime_type");
+    write_json_string (&w, file->mime_type);
+    write_json_key (&w, "content_id");
+    write_json_string (&w, file->content_id);
+    if (file->hashed && ctx->store)
+    {
+        write_json_key (&w, "hash");
+        write_char (&w, '"');
+        write_hex (&w, (uint32)(file->hash >> 32), 8);
+        write_hex (&w, (uint32)file->hash, 8);
+        write_char (&w, '"');
+    }
+    if (!file->body_type)
+    {
+        write_json_key (&w, "checksum");
+        write_json_string (&w, checksum_str (file->checksum));
+    }
+    manifest_end (&w);
+}
+
+/* the message has been parsed, everything in it described already,
+   or the parse has been given up on */
+void
+manifest_message (TNEF_Context *ctx, const Manifest_Message *msg)
+{
+    Writer w;
+    const char *sep = "";
+
+    manifest_begin (ctx, &w, "message");
+    if (msg->error)
+    {
+        write_json_key (&w, "error");
+        write_json_string (&w, msg->error);
+        manifest_end (&w);
+        return;
+    }
+    write_json_key (&w, "tnef");
+    write_text (&w, (msg->is_tnef ? "true" : "false"));
+    if (msg->is_tnef)
+    {
+        write_json_key (&w, "attachments");
+        write_unsigned (&w, (unsigned long)msg->attachments);
+        write_json_key (&w, "bodies");
+        write_char (&w, '[');
+        if (msg->has_rtf)
+        {
+            write_text (&w, "\"rtf\"");
+            sep = ",";
+        }
+        if (msg->has_html)
+        {
+            write_text (&w, sep);
+            write_text (&w, "\"html\"");
+            sep = ",";
+        }
+        if (msg->has_text)
+        {
+            write_text (&w, sep);
+            write_text (&w, "\"text\"");
+        }
+        write_char (&w, ']');
+        write_json_key (&w, "checksum");
+        write_json_string (&w, (ctx->checksum_errors ? "failed" : "ok"));
+    }
+    manifest_end (&w);
+}
+
+/* A FILETIME, 100ns ticks since 1601, as a date in UTC */
+static void
+filetime_to_date (const uint32 ft[2], struct date *dt)
+{
+    unsigned long long secs
+        = ((((unsigned long long)ft[1]) << 32) | ft[0]) / 10000000;
+    unsigned long rem = (unsigned long)(secs % 86400);
+    /* days since 0000-03-01, from which the civil date is worked out
+       with a year starting in March, so that February comes last */
+    unsigned long z = (unsigned long)(secs / 86400) + 584694;
+    unsigned long era = z / 146097;
+    unsigned long doe = z - era * 146097;
+    unsigned long yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    unsigned long doy = doe - (365*yoe + yoe/4 - yoe/100);
+    unsigned long mp = (5*doy + 2) / 153;
+
+    dt->day = (uint16)(doy - (153*mp + 2)/5 + 1);
+    dt->month = (uint16)(mp < 10 ? mp + 3 : mp - 9);
+    dt->year = (uint16)(yoe + era*400 + (dt->month <= 2));
+    dt->hour = (uint16)(rem / 3600);
+    dt->min = (uint16)(rem / 60 % 60);
+    dt->sec = (uint16)(rem % 60);
+    dt->dow = 0;
+}
+
+static void
+write_json_number (Writer *w, const char *fmt, double d)
+{
+    char tmp[64];
+    int n;
+
+    /* NaN and infinities have no JSON */
+    if (d != d || d - d != 0)
+    {
+        write_text (w, "null");
+        return;
+    }
+    n = snprintf (tmp, sizeof (tmp), fmt, d);
+    if (n > 0) write_chars (w, tmp, ((size_t)n < sizeof (tmp)
+                                     ? (size_t)n : sizeof (tmp) - 1));
+}
+
+static void
+write_json_value (Writer *w, mapi_type type, MAPI_Value *v)
+{
+    unsigned long long u = (((unsigned long long)v->data.bytes8[1]) << 32)
+        | v->data.bytes8[0];
+    struct date dt;
+    size_t i;
+
+    switch (type)
+    {
+    case szMAPI_STRING:
+    case szMAPI_UNICODE_STRING:
+        write_json_string (w, (char*)v->data.buf);
+        break;
+
+    case szMAPI_SHORT:
+        write_int16 (w, (int16)v->data.bytes2);
+        break;
+
+    case szMAPI_INT:
+        write_int32 (w, (int32)v->data.bytes4);
+        break;
+
+    case szMAPI_BOOLEAN:
+        write_text (w, (v->data.bytes4 ? "true" : "false"));
+        break;
+
+    case szMAPI_FLOAT:
+        {
+            float f;
+            memmove (&f, &v->data.bytes4, sizeof (f));
+            write_json_number (w, "%.9g", f);
+        }
+        break;
+
+    case szMAPI_DOUBLE:
+    case szMAPI_APPTIME:
+        {
+            double d;
+            memmove (&d, &u, sizeof (d));
+            write_json_number (w, "%.17g", d);
+        }
+        break;
+
+    case szMAPI_CURRENCY:       /* fixed point, 4 decimal places */
+        write_json_number (w, "%.4f", (double)(long long)u / 10000);
+        break;
+
+    case szMAPI_INT8BYTE:
+        {
+            char tmp[32];
+            int n = snprintf (tmp, sizeof (tmp), "%lld", (long long)u);
+            if (n > 0) write_chars (w, tmp, (size_t)n);
+        }
+        break;
+
+    case szMAPI_SYSTIME:
+        filetime_to_date (v->data.bytes8, &dt);
+        write_json_date (w, &dt);
+        break;
+
+    case szMAPI_CLSID:
+        write_char (w, '"');
+        write_hex (w, v->data.guid.data1, 8);
+        write_char (w, '-');
+        write_hex (w, v->data.guid.data2, 4);
+        write_char (w, '-');
+        write_hex (w, v->data.guid.data3, 4);
+        write_char (w, '-');
+        for (i = 0; i < 8; i++)
+        {
+            if (i == 2) write_char (w, '-');
+            write_hex (w, v->data.guid.data4[i], 2);
+        }
+        write_char (w, '"');
+        break;
+
+    case szMAPI_OBJECT:
+    case szMAPI_BINARY:         /* as hex */
+        write_char (w, '"');
+        for (i = 0; i < v->len; i++) write_hex (w, v->data.buf[i], 2);
+        write_char (w, '"');
+        break;
+
+    default:
+        write_text (w, "null");
+        break;
+    }
+}
+
+/* The properties of ctx->props in index, in the order they were asked
+   for, null for those the message does not have (all of them if index
+   is NULL).  Those with more than one value are arrays. */
+void
+manifest_properties (TNEF_Context *ctx, MAPI_Index *index)
+{
+    Writer w;
+    size_t i, j;
+
+    /* decoded before manifest_begin, as a corrupt one gives up */
+    for (i = 0; index && i < ctx->num_props; i++)
+    {
+        MAPI_Prop *prop = mapi_index_find (index, ctx->props[i]);
+        if (prop) mapi_index_decode (ctx, index, prop);
+    }
+
+    manifest_begin (ctx, &w, "properties");
+    write_json_key (&w, "properties");
+    write_char (&w, '{');
+    for (i = 0; i < ctx->num_props; i++)
+    {
+        const char *name = mapi_name_to_str (ctx->props[i]);
+        MAPI_Prop *prop = NULL;
+        MAPI_Attr *a = NULL;
+
+        if (i > 0) write_char (&w, ',');
+        write_char (&w, '"');
+        if (name)
+            write_text (&w, name);
+        else
+        {
+            write_text (&w, "0x");
+            write_hex (&w, ctx->props[i], 4);
+        }
+        write_text (&w, "\":");
+
+        if (index) prop = mapi_index_find (index, ctx->props[i]);
+        if (prop) a = mapi_index_decode (ctx, index, prop);
+        if (a == NULL || a->num_values == 0)
+            write_text (&w, "null");
+        else if (a->num_values == 1)
+            write_json_value (&w, a->type, &a->values[0]);
+        else
+        {
+            write_char (&w, '[');
+            for (j = 0; j < a->num_values; j++)
+            {
+                if (j > 0) write_char (&w, ',');
+                write_json_value (&w, a->type, &a->values[j]);
+            }
+            write_char (&w, ']');
+        }
+    }
+    write_char (&w, '}');
+    manifest_end (&w);
+}
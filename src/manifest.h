@@ -0,0 +1,47 @@
+/*
+ * manifest.h -- describe what was found as JSON, one object a line
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include "file.h"
+#include "options.h"
+
+/* What is known about a message once it has been parsed */
+typedef struct
+{
+    int is_tnef;
+    size_t attachments;
+    int has_text, has_html, has_rtf;
+    const char *error;          /* if it could not be, and nothing else */
+} Manifest_Message;
+
+extern void manifest_file (TNEF_Context *ctx, File *file, const char *path);
+extern void manifest_message (TNEF_Context *ctx, const Manifest_Message *msg);
+extern void manifest_properties (TNEF_Context *ctx, MAPI_Index *index);
+
+#endif /* MANIFEST_H */
@@ -28,6 +28,7 @@
 #include "mapi_attr.h"
 #include "alloc.h"
 #include "options.h"
+#include "unicode.h"
 #include "util.h"
 #include "write.h"
 
@@ -46,7 +47,7 @@ copy_guid_from_buf (GUID* guid, unsigned char *buf, size_t len)
     int idx = 0;
     assert (guid);
     assert (buf);
-    assert (len >= 16);
+    CHECKINPUT (len >= 16);
 
     CHECKINT32(idx, len); guid->data1 = GETINT32(buf + idx); idx += sizeof (uint32);
     CHECKINT16(idx, len); guid->data2 = GETINT16(buf + idx); idx += sizeof (uint16);
@@ -58,94 +59,100 @@ copy_guid_from_buf (GUID* guid, unsigned char *buf, size_t len)
 
 /* dumps info about MAPI attributes... useful for debugging */
 static void
-mapi_attr_dump (MAPI_Attr* attr)
+mapi_attr_dump (TNEF_Context *ctx, MAPI_Attr* attr)
 {
-    char *name = get_mapi_name_str (attr->name);
-    char *type = get_mapi_type_str (attr->type);
+    Writer w;
     size_t i;
 
-    fprintf (stdout, "(MAPI) %s [type: %s] [num_values = %lu] = \n",
-             name, type, (unsigned long)attr->num_values);
+    writer_open (&w, stdout, ctx->dump_limit);
+    write_text (&w, "(MAPI) ");
+    write_name (&w, mapi_name_to_str (attr->name), attr->name);
+    write_text (&w, " [type: ");
+    write_name (&w, mapi_type_to_str (attr->type), attr->type);
+    write_text (&w, "] [num_values = ");
+    write_unsigned (&w, (unsigned long)attr->num_values);
+    write_text (&w, "] = \n");
     if (attr->guid)
     {
-        fprintf (stdout, "\tGUID: ");
-        write_guid (stdout, attr->guid);
-        fputc ('\n', stdout);
+        write_text (&w, "\tGUID: ");
+        write_guid (&w, attr->guid);
+        write_char (&w, '\n');
     }
 
     for (i = 0; i < attr->num_names; i++)
-      fprintf (stdout, "\tname #%d: '%s'\n", (int)i, attr->names[i].data);
+    {
+        write_text (&w, "\tname #");
+        write_unsigned (&w, (unsigned long)i);
+        write_text (&w, ": ");
+        write_string (&w, (char*)attr->names[i].data);
+        write_char (&w, '\n');
+    }
 
     for (i = 0; i < attr->num_values; i++)
     {
-        fprintf (stdout, "\t#%lu [len: %lu] = ",
-                 (unsigned long)i,
-                 (unsigned long)attr->values[i].len);
+        write_text (&w, "\t#");
+        write_unsigned (&w, (unsigned long)i);
+        write_text (&w, " [len: ");
+        write_unsigned (&w, (unsigned long)attr->values[i].len);
+        write_text (&w, "] = ");
 
         switch (attr->type)
         {
         case szMAPI_NULL:
-            fprintf (stdout, "NULL");
+            write_text (&w, "NULL");
             break;
 
         case szMAPI_SHORT:
-            write_int16 (stdout, (int16)attr->values[i].data.bytes2);
+            write_int16 (&w, (int16)attr->values[i].data.bytes2);
             break;
 
         case szMAPI_INT:
-            write_int32 (stdout, (int32)attr->values[i].data.bytes4);
+            write_int32 (&w, (int32)attr->values[i].data.bytes4);
             break;
 
         case szMAPI_FLOAT:
         case szMAPI_DOUBLE:
-            write_float (stdout, (float)attr->values[i].data.bytes4);
+            write_float (&w, (float)attr->values[i].data.bytes4);
             break;
 
         case szMAPI_BOOLEAN:
-            write_boolean (stdout, attr->values[i].data.bytes4);
+            write_boolean (&w, attr->values[i].data.bytes4);
             break;
 
         case szMAPI_STRING:
         case szMAPI_UNICODE_STRING:
-            write_string (stdout, (char*)attr->values[i].data.buf);
+            write_string (&w, (char*)attr->values[i].data.buf);
             break;
 
         case szMAPI_SYSTIME:
         case szMAPI_CURRENCY:
         case szMAPI_INT8BYTE:
         case szMAPI_APPTIME:
-            write_uint64 (stdout, attr->values[i].data.bytes8);
+            write_uint64 (&w, attr->values[i].data.bytes8);
             break;
 
         case szMAPI_ERROR:
-            write_uint32 (stdout, attr->values[i].data.bytes4);
+            write_uint32 (&w, attr->values[i].data.bytes4);
             break;
 
         case szMAPI_CLSID:
-            write_guid (stdout, &attr->values[i].data.guid);
+            write_guid (&w, &attr->values[i].data.guid);
             break;
 
         case szMAPI_OBJECT:
         case szMAPI_BINARY:
-        {
-            size_t x;
-
-            for (x = 0; x < attr->values[i].len; x++)
-            {
-                write_byte (stdout, (uint8)attr->values[i].data.buf[x]);
-                fputc (' ', stdout);
-            }
-        }
-        break;
+            write_bytes (&w, attr->values[i].data.buf, attr->values[i].len,
+                         '\0', ' ');
+            break;
 
         default:
-            fprintf (stdout, "<unknown type>");
+            write_text (&w, "<unknown type>");
             break;
         }
-        fprintf (stdout, "\n");
+        write_char (&w, '\n');
     }
 
-    fflush( NULL );
+    writer_close (&w);
 }
 
 static MAPI_Value*
@@ -167,188 +174,364 @@ alloc_mapi_values (MAPI_Attr* a)
   szMAPI_INT, szMAPI_SYSTIME, szMAPI_UNICODE_STRING, szMAPI_BINARY
 */
 
-/* parses out the MAPI attibutes hidden in the character buffer */
-MAPI_Attr**
-mapi_attr_read (size_t len, unsigned char *buf)
+/* Steps over the property at *idx in buf, as decode_prop would read it
+   but without copying or converting anything, setting *type and *name.
+   Returns 0 if it is not a property that could be read. */
+static int
+skip_prop (TNEF_Context *ctx, unsigned char *buf, size_t len, size_t *idx,
+           mapi_type *type, mapi_name *name)
 {
-    size_t idx = 0;
-    uint32 i,j;
-    assert(len > 4);
-    uint32 num_properties = GETINT32(buf+idx);
-    assert((num_properties+1) != 0);
-    MAPI_Attr** attrs = CHECKED_XMALLOC (MAPI_Attr*, (num_properties + 1));
+    size_t i = *idx;
+    size_t num_values;
+    size_t j;
 
-    idx += 4;
+    CHECKINT16(i, len); *type = GETINT16(buf+i); i += 2;
+    CHECKINT16(i, len); *name = GETINT16(buf+i); i += 2;
 
-    if (!attrs) return NULL;
-    for (i = 0; i < num_properties; i++)
+    if (*name & GUID_EXISTS_FLAG)
     {
-        MAPI_Attr* a = attrs[i] = CHECKED_XCALLOC(MAPI_Attr, 1);
-        MAPI_Value* v = NULL;
+        size_t num_names;
 
-        CHECKINT16(idx, len); a->type = GETINT16(buf+idx); idx += 2;
-        CHECKINT16(idx, len); a->name = GETINT16(buf+idx); idx += 2;
+        CHECKINPUT(len >= i && len - i >= sizeof (GUID));
+        i += sizeof (GUID);
 
-        /* handle special case of GUID prefixed properties */
-        if (a->name & GUID_EXISTS_FLAG)
+        CHECKINT32(i, len); num_names = GETINT32(buf+i); i += 4;
+        if (num_names > 0)
         {
-            /* copy GUID */
-            a->guid = CHECKED_XMALLOC(GUID, 1);
-            copy_guid_from_buf(a->guid, buf+idx, len-idx);
-            idx += sizeof (GUID);
-
-            CHECKINT32(idx, len); a->num_names = GETINT32(buf+idx); idx += 4;
-            if (a->num_names > 0)
+            for (j = 0; j < num_names; j++)
             {
-                size_t i;
+                size_t name_len;
 
-                a->names = CHECKED_XCALLOC(VarLenData, a->num_names);
-                assert(a->names);
-                for (i = 0; i < a->num_names; i++)
-                {
-                    size_t j;
+                CHECKINT32(i, len); name_len = GETINT32(buf+i); i += 4;
+                CHECKINPUT(name_len != 0);
+                CHECKINPUT(i+name_len <= len);
+                i += pad_to_4byte(name_len);
+            }
+        }
+        else
+        {
+            CHECKINT32(i, len); *name = GETINT32(buf+i); i += 4;
+        }
+    }
 
-                    CHECKINT32(idx, len); a->names[i].len = GETINT32(buf+idx); idx += 4;
+    if (*type & MULTI_VALUE_FLAG ||
+        *type == szMAPI_STRING ||
+        *type == szMAPI_UNICODE_STRING ||
+        *type == szMAPI_OBJECT ||
+        *type == szMAPI_BINARY)
+    {
+        CHECKINT32(i, len); num_values = GETINT32(buf+i);
+        i += 4;
+    }
+    else
+    {
+        num_values = 1;
+    }
 
-                    /* read the data into a buffer */
-                    /* read the data into a buffer */
-                    assert(a->names[i].len != 0);
-                    assert(idx+a->names[i].len <= len);
-                    a->names[i].data = unicode_to_utf8(a->names[i].len, buf+idx);
+    if (*type & MULTI_VALUE_FLAG)
+    {
+        *type -= MULTI_VALUE_FLAG;
+    }
 
-                    idx += pad_to_4byte(a->names[i].len);
-                }
-            }
-            else
-            {
-                /* get the 'real' name */
-                CHECKINT32(idx, len); a->name = GETINT32(buf+idx); idx+= 4;
-            }
+    for (j = 0; j < num_values; j++)
+    {
+        size_t size;
+
+        switch (*type)
+        {
+        case szMAPI_SHORT:
+            CHECKINT16(i, len); i += 4;
+            break;
+
+        case szMAPI_INT:
+        case szMAPI_FLOAT:
+        case szMAPI_BOOLEAN:
+            CHECKINT32(i, len); i += 4;
+            break;
+
+        case szMAPI_SYSTIME:
+        case szMAPI_DOUBLE:
+        case szMAPI_APPTIME:
+        case szMAPI_CURRENCY:
+        case szMAPI_INT8BYTE:
+            CHECKINT32(i, len); CHECKINT32(i+4, len); i += 8;
+            break;
+
+        case szMAPI_CLSID:
+            CHECKINPUT(len >= i && len - i >= sizeof (GUID));
+            i += sizeof (GUID);
+            break;
+
+        case szMAPI_STRING:
+        case szMAPI_UNICODE_STRING:
+        case szMAPI_OBJECT:
+        case szMAPI_BINARY:
+            CHECKINT32(i, len); size = GETINT32(buf+i); i += 4;
+            CHECKINPUT(size + i <= len);
+            if (*type == szMAPI_UNICODE_STRING) CHECKINPUT(size != 0);
+            i += pad_to_4byte(size);
+            break;
+
+        case szMAPI_NULL:	/* illegal in input tnef streams */
+        case szMAPI_ERROR:
+        case szMAPI_UNSPECIFIED:
+            fprintf (stderr,
+                     "Invalid attribute, input file may be corrupted\n");
+            if (!ENCODE_SKIP(ctx)) tnef_exit (1);
+            return 0;
+
+        default:		/* should never get here */
+            fprintf (stderr,
+                     "Undefined attribute, input file may be corrupted\n");
+            if (!ENCODE_SKIP(ctx)) tnef_exit (1);
+            return 0;
         }
+    }
+
+    *idx = i;
+    return 1;
+}
+
+/* Reads the property at idx in buf, which skip_prop has been over,
+   into a, which is empty */
+static void
+decode_prop (TNEF_Context *ctx, unsigned char *buf, size_t len, size_t idx,
+             MAPI_Attr *a)
+{
+    uint32 j;
+    MAPI_Value* v = NULL;
+    size_t value_len;           /* as stored, UTF-16 for unicode */
+
+    CHECKINT16(idx, len); a->type = GETINT16(buf+idx); idx += 2;
+    CHECKINT16(idx, len); a->name = GETINT16(buf+idx); idx += 2;
+
+    /* handle special case of GUID prefixed properties */
+    if (a->name & GUID_EXISTS_FLAG)
+    {
+        /* copy GUID */
+        a->guid = CHECKED_XMALLOC(GUID, 1);
+        copy_guid_from_buf(a->guid, buf+idx, len-idx);
+        idx += sizeof (GUID);
 
-        /*
-         * Multi-value types and string/object/binary types have
-         * multiple values
-         */
-        if (a->type & MULTI_VALUE_FLAG ||
-            a->type == szMAPI_STRING ||
-            a->type == szMAPI_UNICODE_STRING ||
-            a->type == szMAPI_OBJECT ||
-            a->type == szMAPI_BINARY)
+        CHECKINT32(idx, len); a->num_names = GETINT32(buf+idx); idx += 4;
+        if (a->num_names > 0)
         {
-            CHECKINT32(idx, len); a->num_values = GETINT32(buf+idx);
-            idx += 4;
+            size_t i;
+
+            a->names = CHECKED_XCALLOC(VarLenData, a->num_names);
+            assert(a->names);
+            for (i = 0; i < a->num_names; i++)
+            {
+                size_t name_len;
+
+                CHECKINT32(idx, len); name_len = GETINT32(buf+idx); idx += 4;
+
+                /* read the data into a buffer, len becoming its length */
+                CHECKINPUT(name_len != 0);
+                CHECKINPUT(idx+name_len <= len);
+                a->names[i].data = unicode_to_utf8(name_len, buf+idx,
+                                                   &a->names[i].len);
+
+                idx += pad_to_4byte(name_len);
+            }
         }
         else
         {
-            a->num_values = 1;
+            /* get the 'real' name */
+            CHECKINT32(idx, len); a->name = GETINT32(buf+idx); idx+= 4;
         }
+    }
 
-        /* Amend the type in case of multi-value type */
-        if (a->type & MULTI_VALUE_FLAG)
-        {
-            a->type -= MULTI_VALUE_FLAG;
-        }
+    /*
+     * Multi-value types and string/object/binary types have
+     * multiple values
+     */
+    if (a->type & MULTI_VALUE_FLAG ||
+        a->type == szMAPI_STRING ||
+        a->type == szMAPI_UNICODE_STRING ||
+        a->type == szMAPI_OBJECT ||
+        a->type == szMAPI_BINARY)
+    {
+        CHECKINT32(idx, len); a->num_values = GETINT32(buf+idx);
+        idx += 4;
+    }
+    else
+    {
+        a->num_values = 1;
+    }
+
+    /* Amend the type in case of multi-value type */
+    if (a->type & MULTI_VALUE_FLAG)
+    {
+        a->type -= MULTI_VALUE_FLAG;
+    }
 
 
-        v = alloc_mapi_values (a);
-        assert(v);
-        for (j = 0; j < a->num_values; j++)
+    /* NULL if there are none */
+    v = alloc_mapi_values (a);
+    for (j = 0; j < a->num_values; j++)
+    {
+        switch (a->type)
         {
-            switch (a->type)
-            {
-            case szMAPI_SHORT:	/* 2 bytes */
-                v->len = 2;
-                CHECKINT16(idx, len); v->data.bytes2 = GETINT16(buf+idx);
-                idx += 4;	/* assume padding of 2, advance by 4! */
-                break;
-
-            case szMAPI_INT:	/* 4 bytes */
-                v->len = 4;
-                CHECKINT32(idx, len); v->data.bytes4 = GETINT32(buf+idx);
-                idx += 4;
-                v++;
-                break;
-
-            case szMAPI_FLOAT:	/* 4 bytes */
-            case szMAPI_BOOLEAN: /* this should be 2 bytes + 2 padding */
-                v->len = 4;
-                CHECKINT32(idx, len); v->data.bytes4 = GETINT32(buf+idx);
-                idx += v->len;
-                break;
-
-            case szMAPI_SYSTIME: /* 8 bytes */
-                v->len = 8;
-                CHECKINT32(idx, len); v->data.bytes8[0] = GETINT32(buf+idx);
-                CHECKINT32(idx+4, len); v->data.bytes8[1] = GETINT32(buf+idx+4);
-                idx += 8;
-                v++;
-                break;
-
-            case szMAPI_DOUBLE:	/* 8 bytes */
-            case szMAPI_APPTIME:
-            case szMAPI_CURRENCY:
-            case szMAPI_INT8BYTE:
-                v->len = 8;
-                CHECKINT32(idx, len); v->data.bytes8[0] = GETINT32(buf+idx);
-                CHECKINT32(idx+4, len); v->data.bytes8[1] = GETINT32(buf+idx+4);
-                idx += v->len;
-                break;
-
-            case szMAPI_CLSID:
-                v->len = sizeof (GUID);
-                copy_guid_from_buf(&v->data.guid, buf+idx, len-idx);
-                idx += v->len;
-                break;
-
-            case szMAPI_STRING:
-            case szMAPI_UNICODE_STRING:
-            case szMAPI_OBJECT:
-            case szMAPI_BINARY:
-                CHECKINT32(idx, len); v->len = GETINT32(buf+idx); idx += 4;
-
-                assert(v->len + idx <= len);
-
-                if (a->type == szMAPI_UNICODE_STRING)
-                {
-                    assert(v->len != 0);
-                    v->data.buf = (unsigned char*)unicode_to_utf8(v->len, buf+idx);
-                }
-                else
-                {
-		  /* add space for a null terminator, in case of evil input */
-                    v->data.buf = CHECKED_XMALLOC_ADDNULL(unsigned char, v->len);
-                    memmove (v->data.buf, buf+idx, v->len);
-		    v->data.buf[v->len] = '\0';
-                }
-
-                idx += pad_to_4byte(v->len);
-                v++;
-                break;
-
-            case szMAPI_NULL:	/* illegal in input tnef streams */
-            case szMAPI_ERROR:
-            case szMAPI_UNSPECIFIED:
-                fprintf (stderr,
-                         "Invalid attribute, input file may be corrupted\n");
-                if (!ENCODE_SKIP) exit (1);
-
-                return NULL;
-
-            default:		/* should never get here */
-                fprintf (stderr,
-                         "Undefined attribute, input file may be corrupted\n");
-                if (!ENCODE_SKIP) exit (1);
-
-                return NULL;
+        case szMAPI_SHORT:	/* 2 bytes */
+            v->len = 2;
+            CHECKINT16(idx, len); v->data.bytes2 = GETINT16(buf+idx);
+            idx += 4;	/* assume padding of 2, advance by 4! */
+            v++;
+            break;
 
+        case szMAPI_INT:	/* 4 bytes */
+            v->len = 4;
+            CHECKINT32(idx, len); v->data.bytes4 = GETINT32(buf+idx);
+            idx += 4;
+            v++;
+            break;
+
+        case szMAPI_FLOAT:	/* 4 bytes */
+        case szMAPI_BOOLEAN: /* this should be 2 bytes + 2 padding */
+            v->len = 4;
+            CHECKINT32(idx, len); v->data.bytes4 = GETINT32(buf+idx);
+            idx += v->len;
+            v++;
+            break;
+
+        case szMAPI_SYSTIME: /* 8 bytes */
+            v->len = 8;
+            CHECKINT32(idx, len); v->data.bytes8[0] = GETINT32(buf+idx);
+            CHECKINT32(idx+4, len); v->data.bytes8[1] = GETINT32(buf+idx+4);
+            idx += 8;
+            v++;
+            break;
+
+        case szMAPI_DOUBLE:	/* 8 bytes */
+        case szMAPI_APPTIME:
+        case szMAPI_CURRENCY:
+        case szMAPI_INT8BYTE:
+            v->len = 8;
+            CHECKINT32(idx, len); v->data.bytes8[0] = GETINT32(buf+idx);
+            CHECKINT32(idx+4, len); v->data.bytes8[1] = GETINT32(buf+idx+4);
+            idx += v->len;
+            v++;
+            break;
+
+        case szMAPI_CLSID:
+            v->len = sizeof (GUID);
+            copy_guid_from_buf(&v->data.guid, buf+idx, len-idx);
+            idx += v->len;
+            v++;
+            break;
+
+        case szMAPI_STRING:
+        case szMAPI_UNICODE_STRING:
+        case szMAPI_OBJECT:
+        case szMAPI_BINARY:
+            CHECKINT32(idx, len); value_len = GETINT32(buf+idx); idx += 4;
+
+            CHECKINPUT(value_len + idx <= len);
+            v->len = value_len;
+
+            if (a->type == szMAPI_UNICODE_STRING)
+            {
+                /* len is that of the UTF-8 rather than the UTF-16 */
+                CHECKINPUT(value_len != 0);
+                v->data.buf = unicode_to_utf8(value_len, buf+idx, &v->len);
             }
-            if (DEBUG_ON) mapi_attr_dump (attrs[i]);
+            else if (a->type == szMAPI_OBJECT
+                     || a->type == szMAPI_BINARY)
+            {
+                /* binary data is only used along with its length,
+                   so it is borrowed from buf rather than copied */
+                v->data.buf = buf+idx;
+            }
+            else
+            {
+                /* add space for a null terminator, in case of evil input */
+                v->data.buf = CHECKED_XMALLOC_ADDNULL(unsigned char, v->len);
+                memmove (v->data.buf, buf+idx, v->len);
+                v->data.buf[v->len] = '\0';
+            }
+
+            idx += pad_to_4byte(value_len);
+            v++;
+            break;
+
+        default:		/* skip_prop has turned away the rest */
+            break;
+        }
+    }
+    if (DEBUG_ON(ctx)) mapi_attr_dump (ctx, a);
+}
+
+/* Finds the MAPI attibutes hidden in the character buffer.  Only the
+   headers of the properties are read, the values are stepped over, so
+   this costs little however many there are that nobody asks for. */
+MAPI_Index*
+mapi_index_read (TNEF_Context *ctx, size_t len, unsigned char *buf,
+                 MAPI_Index **indexp)
+{
+    MAPI_Index *index;
+    size_t idx = 0;
+    size_t max_props;
+    uint32 num_properties;
+    uint32 i;
+
+    CHECKINPUT(len > 4);
+    num_properties = GETINT32(buf+idx);
+    idx += 4;
+
+    /* every property takes at least 8 bytes, so a count beyond that is
+       found out by the scan rather than allocated for */
+    max_props = (len - idx) / 8 + 1;
+    if (num_properties < max_props) max_props = num_properties;
+
+    index = *indexp = CHECKED_XCALLOC (MAPI_Index, 1);
+    index->buf = buf;
+    index->len = len;
+    if (max_props) index->props = CHECKED_XCALLOC (MAPI_Prop, max_props);
+
+    for (i = 0; i < num_properties; i++)
+    {
+        MAPI_Prop *p = &index->props[i];
+
+        CHECKINPUT(i < max_props);
+        p->offset = idx;
+        if (!skip_prop (ctx, buf, len, &idx, &p->type, &p->name))
+        {
+            mapi_index_free (index);
+            *indexp = NULL;
+            return NULL;
         }
+        index->num_props++;
+    }
+
+    return index;
+}
+
+/* The first property called name, or NULL if there is none */
+MAPI_Prop*
+mapi_index_find (MAPI_Index *index, mapi_name name)
+{
+    size_t i;
+
+    for (i = 0; i < index->num_props; i++)
+    {
+        if (index->props[i].name == name) return &index->props[i];
     }
-    attrs[i] = NULL;
+    return NULL;
+}
 
-    return attrs;
+/* The value of prop, decoded the first time it is asked for */
+MAPI_Attr*
+mapi_index_decode (TNEF_Context *ctx, MAPI_Index *index, MAPI_Prop *prop)
+{
+    if (prop->attr == NULL)
+    {
+        /* kept in the index as it is filled in, to be freed with it if
+           the parse is given up on */
+        prop->attr = CHECKED_XCALLOC (MAPI_Attr, 1);
+        decode_prop (ctx, index->buf, index->len, prop->offset, prop->attr);
+    }
+    return prop->attr;
 }
 
 static void
@@ -360,8 +543,7 @@ mapi_attr_free (MAPI_Attr* attr)
         for (i = 0; i < attr->num_values; i++)
         {
             if ((attr->type == szMAPI_STRING)
-                || (attr->type == szMAPI_UNICODE_STRING)
-                || (attr->type == szMAPI_BINARY))
+                || (attr->type == szMAPI_UNICODE_STRING))
             {
                 XFREE (attr->values[i].data.buf);
             }
@@ -380,12 +562,16 @@ mapi_attr_free (MAPI_Attr* attr)
 }
 
 void
-mapi_attr_free_list (MAPI_Attr** attrs)
+mapi_index_free (MAPI_Index *index)
 {
-    int i;
-    for (i = 0; attrs && attrs[i]; i++)
+    size_t i;
+
+    if (index == NULL) return;
+    for (i = 0; i < index->num_props; i++)
     {
-        mapi_attr_free (attrs[i]);
-        XFREE (attrs[i]);
+        mapi_attr_free (index->props[i].attr);
+        XFREE (index->props[i].attr);
     }
+    XFREE (index->props);
+    XFREE (index);
 }
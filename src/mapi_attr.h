@@ -30,6 +30,7 @@
 
 #include "mapi_types.h"
 #include "mapi_names.h"
+#include "options.h"
 
 #define MULTI_VALUE_FLAG 0x1000
 #define GUID_EXISTS_FLAG 0x8000
@@ -72,7 +73,35 @@ typedef struct
     VarLenData *names;
 } MAPI_Attr;
 
-extern MAPI_Attr** mapi_attr_read (size_t len, unsigned char *buf);
-extern void mapi_attr_free_list (MAPI_Attr** attrs);
+/* Where a property is in the buffer it was read from.  Its value is
+   only decoded (once) when asked for. */
+typedef struct
+{
+    mapi_type type;             /* without MULTI_VALUE_FLAG */
+    mapi_name name;
+    size_t offset;
+    MAPI_Attr *attr;            /* NULL until decoded */
+} MAPI_Prop;
+
+typedef struct
+{
+    unsigned char *buf;
+    size_t len;
+    size_t num_props;
+    MAPI_Prop *props;
+} MAPI_Index;
+
+/* Finds the properties in buf, checking that they are all there but
+   decoding none of them.  The values of szMAPI_BINARY and szMAPI_OBJECT
+   properties point into buf, which must outlive the returned index.
+   *indexp is set to it before anything is read, so that it can be
+   freed if the parse is given up on, and is NULL if buf is invalid. */
+extern MAPI_Index* mapi_index_read (TNEF_Context *ctx,
+                                    size_t len, unsigned char *buf,
+                                    MAPI_Index **indexp);
+extern MAPI_Prop* mapi_index_find (MAPI_Index *index, mapi_name name);
+extern MAPI_Attr* mapi_index_decode (TNEF_Context *ctx, MAPI_Index *index,
+                                     MAPI_Prop *prop);
+extern void mapi_index_free (MAPI_Index *index);
 
 #endif /* MAPI_ATTR_H */
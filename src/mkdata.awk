@@ -23,33 +23,36 @@
 # the output of this script is redirected to the right file
 # the environment variable TAG is used for the function name and comments
 #
+# Besides the enum, TAG_to_str and TAG_from_str are generated to look
+# values and their names up in both directions.  They search constant
+# tables, sorted here, so nothing is formatted or stored on the way.
+# Run with LC_ALL=C so that names sort as strcmp orders them.
+#
 
 #
 # Print headers and such.
 #
 BEGIN {
-    HFILE = sprintf ("%ss.h", ENVIRON["TAG"]);
+    TAG = ENVIRON["TAG"];
+    HFILE = sprintf ("%ss.h", TAG);
     HFILEDEF = HFILE;
     HFILEDEF = toupper(HFILEDEF);
     gsub("\\.","_",HFILEDEF);
-    CFILE = sprintf ("%ss.c", ENVIRON["TAG"]);
-    printf "/* This file generated by names.awk do not edit! */\n" > HFILE;
+    CFILE = sprintf ("%ss.c", TAG);
+    printf "/* This file generated by mkdata.awk do not edit! */\n" > HFILE;
     printf "#ifndef %s\n", HFILEDEF > HFILE;
     printf "#define %s\n", HFILEDEF > HFILE;
-    printf "enum _%s {\n", ENVIRON["TAG"]                         > HFILE;
+    printf "enum _%s {\n", TAG                                    > HFILE;
+    N = 0;
+}
 
-    printf "/* This file generated by names.awk do not edit! */\n" > CFILE;
-    printf "#ifdef HAVE_CONFIG_H\n"                                > CFILE;
-    printf "#include \"config.h\"\n"                               > CFILE;
-    printf "#endif\n"                                              > CFILE;
-    printf "#include \"common.h\"\n"                               > CFILE;
-    printf "#include \"%s\"\n", HFILE                              > CFILE;
-    printf "char*\n"                                               > CFILE;
-    printf "get_%s_str(uint16 d)\n", ENVIRON["TAG"]                > CFILE;
-    printf "{\n"                                                   > CFILE;
-    printf "    static char buf[128];\n"                           > CFILE;
-    printf "    static char* str;\n"                               > CFILE;
-    printf "    switch(d) {\n"                                     > CFILE;
+# the value of a hex constant such as 0x800F
+function hex(s,    i, v) {
+    v = 0;
+    s = tolower(substr(s, 3));
+    for (i = 1; i <= length(s); i++)
+        v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1;
+    return v;
 }
 
 #
@@ -68,9 +71,10 @@ BEGIN {
 #   printf "#define %-10s\t%s\t/* %s */\n", $1, $2, NAME          > HFILE;
    printf "\t%-45s = %s,\n", $1, $2 > HFILE
 
-   printf "    case %s:\n", $1                                    > CFILE;
-   printf "        str=\"%s\";\n", NAME                           > CFILE;
-   printf "        break;\n"                                      > CFILE;
+   SYM[N] = $1;
+   VAL[N] = hex($2);
+   STR[N] = NAME;
+   N++;
 }
 
 #
@@ -78,23 +82,69 @@ BEGIN {
 #
 END {
     printf "};\n" > HFILE;
-    printf "typedef enum _%s %s;\n", ENVIRON["TAG"], ENVIRON["TAG"] > HFILE;
-    printf "extern char*\n"                                        > HFILE;
-    printf "get_%s_str(uint16 d);\n", ENVIRON["TAG"]               > HFILE;
+    printf "typedef enum _%s %s;\n", TAG, TAG                     > HFILE;
+    printf "/* the name of d, or NULL if it has none */\n"         > HFILE;
+    printf "extern const char*\n"                                  > HFILE;
+    printf "%s_to_str(uint16 d);\n", TAG                           > HFILE;
+    printf "/* stores the value named str in *d, returns 0 if there is none */\n" > HFILE;
+    printf "extern int\n"                                          > HFILE;
+    printf "%s_from_str(const char *str, uint16 *d);\n", TAG       > HFILE;
     printf "#endif /* %s */\n", HFILEDEF > HFILE;
 
-    printf "    default:\n"                                        > CFILE;
-    printf "        str=NULL;\n"                                   > CFILE;
-    printf "        break;\n"                                      > CFILE;
-    printf "    }\n"                                               > CFILE;
-    printf "    if ( str )\n"                                      > CFILE;
-    printf "    {\n"                                               > CFILE;
-    printf "        sprintf(buf,\"%%s <%%04x>\",str,d);\n"         > CFILE;
+    # insertion sorts, there are only a few hundred entries
+    for (i = 0; i < N; i++) BYVAL[i] = BYSTR[i] = i;
+    for (i = 1; i < N; i++) {
+        k = BYVAL[i];
+        for (j = i - 1; j >= 0 && VAL[BYVAL[j]] > VAL[k]; j--)
+            BYVAL[j+1] = BYVAL[j];
+        BYVAL[j+1] = k;
+        k = BYSTR[i];
+        for (j = i - 1; j >= 0 && (STR[BYSTR[j]] "") > (STR[k] ""); j--)
+            BYSTR[j+1] = BYSTR[j];
+        BYSTR[j+1] = k;
+    }
+
+    printf "/* This file generated by mkdata.awk do not edit! */\n" > CFILE;
+    printf "#ifdef HAVE_CONFIG_H\n"                                > CFILE;
+    printf "#include \"config.h\"\n"                               > CFILE;
+    printf "#endif\n"                                              > CFILE;
+    printf "#include \"common.h\"\n"                               > CFILE;
+    printf "#include \"%s\"\n", HFILE                              > CFILE;
+    printf "typedef struct { uint16 value; const char *str; } Entry;\n" > CFILE;
+    printf "/* sorted by value */\n"                               > CFILE;
+    printf "static const Entry by_value[] = {\n"                   > CFILE;
+    for (i = 0; i < N; i++)
+        printf "    { %s, \"%s\" },\n", SYM[BYVAL[i]], STR[BYVAL[i]] > CFILE;
+    printf "};\n"                                                  > CFILE;
+    printf "/* sorted by name */\n"                                > CFILE;
+    printf "static const Entry by_str[] = {\n"                     > CFILE;
+    for (i = 0; i < N; i++)
+        printf "    { %s, \"%s\" },\n", SYM[BYSTR[i]], STR[BYSTR[i]] > CFILE;
+    printf "};\n"                                                  > CFILE;
+    printf "#define NUM_ENTRIES (sizeof (by_value) / sizeof (Entry))\n" > CFILE;
+    printf "const char*\n"                                         > CFILE;
+    printf "%s_to_str(uint16 d)\n", TAG                            > CFILE;
+    printf "{\n"                                                   > CFILE;
+    printf "    size_t lo = 0, hi = NUM_ENTRIES;\n"                > CFILE;
+    printf "    while (lo < hi) {\n"                               > CFILE;
+    printf "        size_t mid = lo + (hi - lo) / 2;\n"            > CFILE;
+    printf "        if (by_value[mid].value == d) return by_value[mid].str;\n" > CFILE;
+    printf "        if (by_value[mid].value < d) lo = mid + 1;\n"  > CFILE;
+    printf "        else hi = mid;\n"                              > CFILE;
     printf "    }\n"                                               > CFILE;
-    printf "    else\n"                                            > CFILE;
-    printf "    {\n"                                               > CFILE;
-    printf "        sprintf(buf,\"%%04x\",d);\n"                   > CFILE;
+    printf "    return NULL;\n"                                    > CFILE;
+    printf "}\n"                                                   > CFILE;
+    printf "int\n"                                                 > CFILE;
+    printf "%s_from_str(const char *str, uint16 *d)\n", TAG        > CFILE;
+    printf "{\n"                                                   > CFILE;
+    printf "    size_t lo = 0, hi = NUM_ENTRIES;\n"                > CFILE;
+    printf "    while (lo < hi) {\n"                               > CFILE;
+    printf "        size_t mid = lo + (hi - lo) / 2;\n"            > CFILE;
+    printf "        int cmp = strcmp (by_str[mid].str, str);\n"    > CFILE;
+    printf "        if (cmp == 0) { *d = by_str[mid].value; return 1; }\n" > CFILE;
+    printf "        if (cmp < 0) lo = mid + 1;\n"                  > CFILE;
+    printf "        else hi = mid;\n"                              > CFILE;
     printf "    }\n"                                               > CFILE;
-    printf "    return buf;\n"                                     > CFILE;
+    printf "    return 0;\n"                                       > CFILE;
     printf "}\n"                                                   > CFILE;
 }
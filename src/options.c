@@ -27,5 +27,10 @@
 
 #include "options.h"
 
-/* Global variables, used by all (or nearly all) functions */
-int g_flags = NONE;     /* program options */
+void
+context_init (TNEF_Context *ctx, int flags, size_t alloc_limit)
+{
+    memset (ctx, '\0', sizeof (TNEF_Context));
+    ctx->flags = flags;
+    ctx->alloc_limit = alloc_limit;
+}
@@ -27,24 +27,48 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "common.h"
+#include "libtnef.h"
 
-/* Global variables, used by all (or nearly all) functions */
-extern int g_flags;     /* program options */
+/* Everything a parse needs to know besides its input.  Each parse_file
+   call has its own so that any number of them can run at once. */
+typedef struct
+{
+    int flags;                  /* program options, see below */
+    size_t alloc_limit;         /* see set_alloc_limit, 0 for none */
+    size_t dump_limit;          /* bytes of a value --debug shows, 0 for all */
+    struct parse_state *state;  /* of the parse in progress, in tnef.c */
+    const TNEF_Callbacks *callbacks; /* instead of files, for libtnef */
+    int stopped;                /* a callback asked to stop */
+    const char *source;         /* name of the input, for --json */
+    struct tar_output *tar;     /* --tar, instead of creating files */
+    struct store *store;        /* --store, files are links into it */
+    struct async_writer *async; /* --async-write, see async.c */
+    struct async_batch *writes; /* what this parse gave to async */
+    struct output_dir *output;  /* where files are written, output.c */
+    struct backup_names *backups; /* for --number-backups, see path.c */
+    unsigned int checksum_errors; /* seen so far, when ignored */
+    const uint16 *props;        /* --props, the MAPI properties to show */
+    size_t num_props;
+} TNEF_Context;
+
+extern void context_init (TNEF_Context *ctx, int flags, size_t alloc_limit);
 
 /* macros for dealing with program flags */
-#define DEBUG_ON ((g_flags)&DBG_OUT)
-#define VERBOSE_ON ((g_flags)&VERBOSE)
-#define LIST_ONLY ((g_flags)&LIST)
-#define SHOW_MIME ((g_flags)&LISTMIME)
-#define USE_PATHS ((g_flags)&PATHS)
-#define INTERACTIVE ((g_flags)&CONFIRM)
-#define OVERWRITE_FILES ((g_flags)&OVERWRITE)
-#define NUMBER_FILES ((g_flags)&NUMBERED)
-#define CHECKSUM_SKIP ((g_flags)&CHECKSUM_OK)
-#define ENCODE_SKIP ((g_flags)&ENCODE_OK)
-#define CRUFT_SKIP ((g_flags)&CRUFT_OK)
-#define UNIX_FS ((g_flags)&UNIX_PATHS)
-#define ABSOLUTE_OK ((g_flags)&ABSOLUTE_PATHS)
+#define DEBUG_ON(c) ((c)->flags&DBG_OUT)
+#define VERBOSE_ON(c) ((c)->flags&VERBOSE)
+#define LIST_ONLY(c) ((c)->flags&LIST)
+#define SHOW_MIME(c) ((c)->flags&LISTMIME)
+#define USE_PATHS(c) ((c)->flags&PATHS)
+#define INTERACTIVE(c) ((c)->flags&CONFIRM)
+#define OVERWRITE_FILES(c) ((c)->flags&OVERWRITE)
+#define NUMBER_FILES(c) ((c)->flags&NUMBERED)
+#define CHECKSUM_SKIP(c) ((c)->flags&CHECKSUM_OK)
+#define ENCODE_SKIP(c) ((c)->flags&ENCODE_OK)
+#define CRUFT_SKIP(c) ((c)->flags&CRUFT_OK)
+#define UNIX_FS(c) ((c)->flags&UNIX_PATHS)
+#define ABSOLUTE_OK(c) ((c)->flags&ABSOLUTE_PATHS)
+#define VERIFY_CHECKSUMS(c) ((c)->flags&VERIFY)
+#define JSON_OUT(c) ((c)->flags&JSON)
 
 /* flags to modify behaviour of file parsing */
 enum { NONE    	= 0x00,
@@ -61,7 +85,11 @@ enum { NONE    	= 0x00,
        ENCODE_OK = 0x400,
        CRUFT_OK = 0x800,
        UNIX_PATHS = 0x1000,
-       ABSOLUTE_PATHS = 0x2000
+       ABSOLUTE_PATHS = 0x2000,
+       VERIFY = 0x4000,
+       BATCH = 0x8000,
+       JSON = 0x10000,
+       ASYNC = 0x20000
 };
 
 #endif /* OPTIONS_H */
@@ -0,0 +1,489 @@
+/*
+ * output.c -- the directory files are extracted into
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       Where openat and friends are available the output directory is
+ *       opened once and every file is created relative to it, or to the
+ *       subdirectory it is in, which is opened (and made) once as well.
+ *       On a network file system each lookup of a component of a path
+ *       can be a round trip, so this saves walking down to the
+ *       directory again for every check, create and rename.  Elsewhere
+ *       the same is done with whole paths.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include <errno.h>
+#if HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+#if HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#endif
+
+/* glibc only declares it with _GNU_SOURCE, which does not agree with
+   the basename of common.h */
+#if HAVE_COPY_FILE_RANGE && !HAVE_DECL_COPY_FILE_RANGE
+extern ssize_t copy_file_range (int, off_t*, int, off_t*, size_t,
+                                unsigned int);
+#endif
+
+#include "alloc.h"
+#include "output.h"
+#include "path.h"
+
+/* fstatat, mkdirat and the rest came along with these */
+#if HAVE_OPENAT && HAVE_FDOPENDIR
+#  define USE_AT_FUNCS 1
+#endif
+
+#if USE_AT_FUNCS
+#  ifndef O_DIRECTORY
+#    define O_DIRECTORY 0
+#  endif
+
+typedef struct output_subdir
+{
+    char *path;                 /* relative to the output directory */
+    int fd;
+    struct output_subdir *next;
+} Output_Subdir;
+#endif /* USE_AT_FUNCS */
+
+struct output_dir
+{
+    char *name;                 /* as given, NULL for the current one */
+#if USE_AT_FUNCS
+    int fd;                     /* of name, AT_FDCWD for the current one */
+    Output_Subdir *subdirs;     /* opened so far, the latest first */
+#endif
+};
+
+Output_Dir*
+output_open (const char *directory)
+{
+    Output_Dir *out = XCALLOC (Output_Dir, 1);
+
+    out->name = (directory && *directory) ? xstrdup (directory) : NULL;
+#if USE_AT_FUNCS
+    out->fd = AT_FDCWD;
+    if (out->name)
+    {
+        out->fd = open (out->name, O_RDONLY | O_DIRECTORY);
+        if (out->fd < 0)
+        {
+            int saved = errno;
+            XFREE (out->name);
+            XFREE (out);
+            errno = saved;
+            return NULL;
+        }
+    }
+#endif
+    return out;
+}
+
+void
+output_close (Output_Dir *out)
+{
+    if (out == NULL) return;
+#if USE_AT_FUNCS
+    while (out->subdirs)
+    {
+        Output_Subdir *sub = out->subdirs;
+        out->subdirs = sub->next;
+        close (sub->fd);
+        XFREE (sub->path);
+        XFREE (sub);
+    }
+    if (out->fd != AT_FDCWD) close (out->fd);
+#endif
+    XFREE (out->name);
+    XFREE (out);
+}
+
+/* "DIR" + "/abs" is DIR/abs as concat_fname has it, absolute paths are
+   only absolute when there is no output directory */
+static const char*
+relative_path (Output_Dir *out, const char *path)
+{
+    if (out->name) while (*path == '/') path++;
+    return path;
+}
+
+/* whether the len chars at name are ".." */
+static int
+is_parent (const char *name, size_t len)
+{
+    return (len == 2 && name[0] == '.' && name[1] == '.');
+}
+
+#if USE_AT_FUNCS
+
+/* the fd of the first len chars of dir, relative to the output
+   directory, which is made and opened the first time it is needed */
+static int
+subdir_fd (Output_Dir *out, const char *dir, size_t len)
+{
+    Output_Subdir *sub;
+    const char *name;
+    char *path;
+    int parent, fd;
+
+    while (len > 0 && dir[len-1] == '/') len--;
+    if (len == 0) return out->fd;
+
+    for (sub = out->subdirs; sub; sub = sub->next)
+    {
+        if (strncmp (sub->path, dir, len) == 0 && sub->path[len] == '\0')
+            return sub->fd;
+    }
+
+    name = dir + len;
+    while (name > dir && name[-1] != '/') name--;
+    if (is_parent (name, dir + len - name))
+    {
+        /* would lead out of the output directory */
+        errno = EPERM;
+        return -1;
+    }
+    parent = subdir_fd (out, dir, name - dir);
+    if (parent == -1) return -1;
+    if (dir + len - name == 1 && *name == '.') return parent;
+
+    path = CHECKED_XMALLOC (char, len + 1);
+    memmove (path, dir, len);
+    path[len] = '\0';
+    name = path + (name - dir);
+
+    if (mkdirat (parent, name, 0777) != 0 && errno != EEXIST)
+        fd = -1;
+    else
+        fd = openat (parent, name, O_RDONLY | O_DIRECTORY);
+    if (fd == -1)
+    {
+        int saved = errno;
+        XFREE (path);
+        errno = saved;
+        return -1;
+    }
+
+    sub = XCALLOC (Output_Subdir, 1);
+    sub->path = path;
+    sub->fd = fd;
+    sub->next = out->subdirs;
+    out->subdirs = sub;
+    return fd;
+}
+
+/* the fd of the directory path is in, or -1, with *base set to the
+   name of path in there */
+static int
+resolve (Output_Dir *out, const char *path, const char **base)
+{
+    const char *slash;
+
+    path = relative_path (out, path);
+    if (*path == '/')
+    {
+        *base = path;
+        return AT_FDCWD;
+    }
+    slash = strrchr (path, '/');
+    if (slash == NULL)
+    {
+        *base = path;
+        return out->fd;
+    }
+    *base = slash + 1;
+    return subdir_fd (out, path, slash - path);
+}
+
+int
+output_exists (Output_Dir *out, const char *path)
+{
+    struct stat buf;
+    const char *base;
+    int fd = resolve (out, path, &base);
+
+    return (fd != -1 && fstatat (fd, base, &buf, 0) == 0);
+}
+
+/* creates path, or empties it, to be written, returning its fd */
+int
+output_create (Output_Dir *out, const char *path)
+{
+    const char *base;
+    int fd = resolve (out, path, &base);
+
+    if (fd == -1) return -1;
+    return openat (fd, base, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+}
+
+/* creates path, empty, failing with EEXIST if it is there already */
+int
+output_claim (Output_Dir *out, const char *path)
+{
+    const char *base;
+    int fd = resolve (out, path, &base);
+
+    if (fd != -1) fd = openat (fd, base, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd == -1) return -1;
+    close (fd);
+    return 0;
+}
+
+/* moves the file from, a path as it is, to path */
+int
+output_rename (Output_Dir *out, const char *from, const char *path)
+{
+    const char *base;
+    int fd = resolve (out, path, &base);
+
+    if (fd == -1) return -1;
+    return renameat (AT_FDCWD, from, fd, base);
+}
+
+/* makes path a hard link to from, a path as it is */
+int
+output_link (Output_Dir *out, const char *from, const char *path)
+{
+    const char *base;
+    int fd = resolve (out, path, &base);
+
+    if (fd == -1) return -1;
+    return linkat (AT_FDCWD, from, fd, base, 0);
+}
+
+int
+output_unlink (Output_Dir *out, const char *path)
+{
+    const char *base;
+    int fd = resolve (out, path, &base);
+
+    if (fd == -1) return -1;
+    return unlinkat (fd, base, 0);
+}
+
+/* opens the directory path is in, to be read */
+DIR*
+output_opendir (Output_Dir *out, const char *path)
+{
+    const char *base;
+    int fd = resolve (out, path, &base);
+    DIR *d;
+
+    if (fd == -1) return NULL;
+    if (*base == '/')
+    {
+        /* an absolute path, base is all of it */
+        char *dir = xstrdup (base);
+        char *slash = strrchr (dir, '/');
+        slash[(slash == dir) ? 1 : 0] = '\0';
+        d = opendir (dir);
+        XFREE (dir);
+        return d;
+    }
+    fd = openat (fd, ".", O_RDONLY | O_DIRECTORY);
+    if (fd == -1) return NULL;
+    d = fdopendir (fd);
+    if (d == NULL) close (fd);
+    return d;
+}
+
+#else /* !USE_AT_FUNCS */
+
+/* path as it is to be opened, after making the directories it is in
+   below the output directory, or NULL if it leads out of that */
+static char*
+full_path (Output_Dir *out, const char *path)
+{
+    const char *dir, *slash;
+    char *full;
+    char *p;
+
+    path = relative_path (out, path);
+    for (dir = path; *path != '/' && (slash = strchr (dir, '/')) != NULL;
+         dir = slash + 1)
+    {
+        if (is_parent (dir, slash - dir))
+        {
+            errno = EPERM;
+            return NULL;
+        }
+    }
+    full = concat_fname (out->name, path);
+    if (*path != '/')
+    {
+        for (p = full + (out->name ? strlen (out->name) + 1 : 0);
+             (p = strchr (p, '/')) != NULL; p++)
+        {
+            *p = '\0';
+            mkdir (full, 0777);
+            *p = '/';
+        }
+    }
+    return full;
+}
+
+int
+output_exists (Output_Dir *out, const char *path)
+{
+    char *full = full_path (out, path);
+    int ret = full && file_exists (full);
+    XFREE (full);
+    return ret;
+}
+
+int
+output_create (Output_Dir *out, const char *path)
+{
+    char *full = full_path (out, path);
+    int fd;
+
+    if (full == NULL) return -1;
+    fd = open (full, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    XFREE (full);
+    return fd;
+}
+
+int
+output_claim (Output_Dir *out, const char *path)
+{
+    char *full = full_path (out, path);
+    int fd;
+
+    if (full == NULL) return -1;
+    fd = open (full, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    XFREE (full);
+    if (fd == -1) return -1;
+    close (fd);
+    return 0;
+}
+
+int
+output_rename (Output_Dir *out, const char *from, const char *path)
+{
+    char *full = full_path (out, path);
+    int ret;
+
+    if (full == NULL) return -1;
+    ret = rename (from, full);
+    XFREE (full);
+    return ret;
+}
+
+int
+output_link (Output_Dir *out, const char *from, const char *path)
+{
+    char *full = full_path (out, path);
+    int ret;
+
+    if (full == NULL) return -1;
+    ret = link (from, full);
+    XFREE (full);
+    return ret;
+}
+
+int
+output_unlink (Output_Dir *out, const char *path)
+{
+    char *full = full_path (out, path);
+    int ret;
+
+    if (full == NULL) return -1;
+    ret = unlink (full);
+    XFREE (full);
+    return ret;
+}
+
+DIR*
+output_opendir (Output_Dir *out, const char *path)
+{
+    char *full = full_path (out, path);
+    char *slash;
+    DIR *d;
+
+    if (full == NULL) return NULL;
+    slash = strrchr (full, '/');
+    if (slash == NULL)
+        d = opendir (".");
+    else
+    {
+        slash[(slash == full) ? 1 : 0] = '\0';
+        d = opendir (full);
+    }
+    XFREE (full);
+    return d;
+}
+
+#endif /* USE_AT_FUNCS */
+
+/* output_create, as a stream */
+FILE*
+output_fopen (Output_Dir *out, const char *path)
+{
+    int fd = output_create (out, path);
+    FILE *fp;
+
+    if (fd == -1) return NULL;
+    fp = fdopen (fd, "wb");
+    if (fp == NULL) close (fd);
+    return fp;
+}
+
+/* Appends the len bytes at offset in the file in_fd to what has been
+   written to out_fd, without them passing through here: copy_file_range
+   shares the blocks on file systems which can (XFS, btrfs), or copies
+   them within the kernel, and sendfile does the latter where that
+   cannot be used (older kernels, across file systems).  Returns how
+   many bytes it copied, possibly none, the rest is up to the caller. */
+size_t
+output_copy_range (int out_fd, int in_fd, off_t offset, size_t len)
+{
+    size_t done = 0;
+
+#if HAVE_COPY_FILE_RANGE
+    while (done < len)
+    {
+        off_t from = offset + (off_t)done;
+        ssize_t n = copy_file_range (in_fd, &from, out_fd, NULL,
+                                     len - done, 0);
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+#endif
+#if HAVE_SENDFILE && HAVE_SYS_SENDFILE_H
+    while (done < len)
+    {
+        off_t from = offset + (off_t)done;
+        ssize_t n = sendfile (out_fd, in_fd, &from, len - done);
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+#endif
+    return done;
+}
@@ -0,0 +1,56 @@
+/*
+ * output.h -- the directory files are extracted into
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include <dirent.h>
+
+/* Output_Dir -- the directory a parse extracts into, opened once, and
+   the subdirectories of it that --use-paths has written to, made when
+   first needed.  The paths given to the functions below are relative
+   to it (unless absolute) and are looked up relative to the directory
+   they are in, so the directories above are not walked each time.
+   Those returning int return 0 on success and -1 with errno set. */
+typedef struct output_dir Output_Dir;
+
+extern Output_Dir* output_open (const char *directory);
+extern void output_close (Output_Dir *out);
+
+extern int output_exists (Output_Dir *out, const char *path);
+extern int output_create (Output_Dir *out, const char *path);
+extern FILE* output_fopen (Output_Dir *out, const char *path);
+extern int output_claim (Output_Dir *out, const char *path);
+extern int output_rename (Output_Dir *out, const char *from, const char *path);
+extern int output_link (Output_Dir *out, const char *from, const char *path);
+extern int output_unlink (Output_Dir *out, const char *path);
+extern DIR* output_opendir (Output_Dir *out, const char *path);
+
+extern size_t output_copy_range (int out_fd, int in_fd, off_t offset,
+                                 size_t len);
+
+#endif /* OUTPUT_H */
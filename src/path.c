@@ -25,6 +25,8 @@
 
 #include "common.h"
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 
 #if HAVE_SYS_STAT_H
 #  include <sys/stat.h>
@@ -32,8 +34,10 @@
 
 #include "alloc.h"
 #include "options.h"
+#include "output.h"
 #include "path.h"
 #include "debug.h"
+#include "util.h"
 
 #if !HAVE_RINDEX && HAVE_STRRCHR
 #  define rindex strrchr
@@ -99,29 +103,182 @@ concat_fname (const char *fname1, const char* fname2)
 int
 file_exists (const char *fname)
 {
-    static struct stat buf;
+    struct stat buf;
     return (stat (fname, &buf) == 0);
 }
 
-/* finds a filename fname.N where N >= 1 and is not the name of an existing
-   filename.  Assumes that fname does not already have such an extension */
+/* --number-backups.  The highest N of the names BASE.N in a directory
+   is found by reading the directory once, the first time it is needed
+   in a parse, and kept up to date from then on, so that the next name
+   is found without trying the names of all the earlier backups.  Names
+   are claimed by creating them with O_EXCL, other processes writing to
+   the same directory only cost a retry. */
+
+typedef struct
+{
+    char *base;                 /* NULL for an empty slot */
+    unsigned long max;          /* highest N of base.N */
+} Backup_Name;
+
+struct backup_names
+{
+    char *dir;
+    Backup_Name *names;         /* open addressing, at most half full */
+    size_t size;
+    size_t count;
+    struct backup_names *next;  /* the next directory */
+};
+
+#define BACKUP_NAMES_SIZE 64
+
+static size_t
+hash_name (const char *s, size_t len)
+{
+    size_t h = 2166136261u;
+    while (len--) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+/* the slot of the len chars of base, or the empty one where it would go */
+static Backup_Name*
+backup_slot (Backup_Name *names, size_t size, const char *base, size_t len)
+{
+    size_t i = hash_name (base, len) & (size - 1);
+
+    while (names[i].base
+           && (strncmp (names[i].base, base, len) != 0
+               || names[i].base[len] != '\0'))
+        i = (i + 1) & (size - 1);
+    return &names[i];
+}
+
+static Backup_Name*
+backup_name (struct backup_names *dir, const char *base, size_t len)
+{
+    Backup_Name *slot = backup_slot (dir->names, dir->size, base, len);
+
+    if (slot->base) return slot;
+
+    if (2 * (dir->count + 1) > dir->size)
+    {
+        Backup_Name *names = XCALLOC (Backup_Name, 2 * dir->size);
+        size_t i;
+        for (i = 0; i < dir->size; i++)
+        {
+            if (dir->names[i].base)
+                *backup_slot (names, 2 * dir->size, dir->names[i].base,
+                              strlen (dir->names[i].base)) = dir->names[i];
+        }
+        XFREE (dir->names);
+        dir->names = names;
+        dir->size *= 2;
+        slot = backup_slot (dir->names, dir->size, base, len);
+    }
+    slot->base = CHECKED_XMALLOC (char, len + 1);
+    memmove (slot->base, base, len);
+    slot->base[len] = '\0';
+    dir->count++;
+    return slot;
+}
+
+/* notes name if it is BASE.N */
+static void
+scan_backup_name (struct backup_names *dir, const char *name)
+{
+    const char *dot = strrchr (name, '.');
+    const char *p;
+    unsigned long n = 0;
+    Backup_Name *slot;
+
+    if (dot == NULL || dot == name || dot[1] == '\0') return;
+    for (p = dot + 1; *p; p++)
+    {
+        if (!isdigit ((unsigned char)*p)) return;
+        if (n > (ULONG_MAX - 9) / 10) return;
+        n = 10 * n + (*p - '0');
+    }
+    slot = backup_name (dir, name, dot - name);
+    if (n > slot->max) slot->max = n;
+}
+
+/* the names of the directory path is in, dir being its name */
+static struct backup_names*
+backup_names (TNEF_Context *ctx, const char *dir, const char *path)
+{
+    struct backup_names *names;
+    DIR *d;
+    struct dirent *entry;
+
+    for (names = ctx->backups; names; names = names->next)
+    {
+        if (strcmp (names->dir, dir) == 0) return names;
+    }
+
+    names = CHECKED_XCALLOC (struct backup_names, 1);
+    names->dir = xstrdup (dir);
+    names->size = BACKUP_NAMES_SIZE;
+    names->names = XCALLOC (Backup_Name, names->size);
+    names->next = ctx->backups;
+    ctx->backups = names;
+
+    d = output_opendir (ctx->output, path);
+    if (d)
+    {
+        while ((entry = readdir (d)) != NULL)
+            scan_backup_name (names, entry->d_name);
+        closedir (d);
+    }
+    return names;
+}
+
+/* Creates fname.N in ctx->output, N >= 1 and not the name of an
+   existing file, and returns its name.  The new file is empty, it is
+   only there so that the name is not taken by anyone else.  Assumes
+   that fname does not already have such an extension */
 char *
-find_free_number (const char *fname)
+find_free_number (TNEF_Context *ctx, const char *fname)
 {
-    size_t len = (strlen(fname)
-                  + 1	/* '.' */
-                  + 5	/* big enough for our purposes (i hope) */
-                  + 1);	/* NULL */
-    char *tmp = CHECKED_XMALLOC (char, len);
-    int counter = 1;
-    do
+    const char *slash = strrchr (fname, '/');
+    const char *base = slash ? slash + 1 : fname;
+    char *dir = CHECKED_XMALLOC (char, base - fname + 1);
+    Backup_Name *name;
+    char *tmp = CHECKED_XMALLOC (char, strlen (fname) + 1 + 20 + 1);
+
+    memmove (dir, fname, base - fname);
+    dir[base - fname] = '\0';
+    name = backup_name (backup_names (ctx, dir, fname), base, strlen (base));
+    XFREE (dir);
+
+    for (;;)
     {
-        sprintf (tmp, "%s.%d", fname, counter++);
+        sprintf (tmp, "%s.%lu", fname, ++name->max);
+        if (output_claim (ctx->output, tmp) == 0) break;
+        if (errno != EEXIST)
+        {
+            perror (tmp);
+            tnef_exit (1);
+        }
     }
-    while (file_exists(tmp));
     return tmp;
 }
 
+/* Frees what find_free_number remembered during a parse */
+void
+forget_backup_names (TNEF_Context *ctx)
+{
+    while (ctx->backups)
+    {
+        struct backup_names *names = ctx->backups;
+        size_t i;
+
+        ctx->backups = names->next;
+        for (i = 0; i < names->size; i++) XFREE (names->names[i].base);
+        XFREE (names->names);
+        XFREE (names->dir);
+        XFREE (names);
+    }
+}
+
 /* windows pathname manipulation routines */
 
 /* per windows file manager, these aren't allowed in filenames */
@@ -137,7 +294,7 @@ static char unsavory_unix_chars[] = {
 };
 
 static int
-could_be_a_windows_path( const char *fname )
+could_be_a_windows_path( TNEF_Context *ctx, const char *fname )
 {
     const char *up;
 
@@ -182,7 +339,7 @@ could_be_a_windows_path( const char *fname )
 
     /* found nothing to the contrary, so we might just be a path */
 
-    if (DEBUG_ON) debug_print( "!!windows path possible: %s\n", fname );
+    if (DEBUG_ON(ctx)) debug_print( ctx, "!!windows path possible: %s\n", fname );
 
     return 1;
 }
@@ -195,7 +352,7 @@ static unsigned char hex_digits[16] = {
 #define SLOP 4		/* a minimum rational buffer size */
 
 static char *
-sanitize_filename( const char *fname )
+sanitize_filename( TNEF_Context *ctx, const char *fname )
 {
     char *buf, *bp;
     const char *cp, *up;
@@ -245,7 +402,7 @@ sanitize_filename( const char *fname )
 
             if ( flag ) break;		/* while loop... */
 
-            if ( UNIX_FS )
+            if ( UNIX_FS(ctx) )
             {
                 /* non-ascii chars */
 
@@ -311,7 +468,7 @@ sanitize_filename( const char *fname )
 */
 
 char *
-munge_fname( const char *fname )
+munge_fname( TNEF_Context *ctx, const char *fname )
 {
     char *dir, *base, *p, *fpd, *fpb;
 
@@ -321,11 +478,11 @@ munge_fname( const char *fname )
       return NULL;
     }
 
-    if ( USE_PATHS )
+    if ( USE_PATHS(ctx) )
     {
         /* evaluate windows path potential */
 
-        if ( could_be_a_windows_path( (char *)fname ) )
+        if ( could_be_a_windows_path( ctx, (char *)fname ) )
         {
             /* split fname after last path separator */
 
@@ -349,15 +506,15 @@ munge_fname( const char *fname )
 
             if ( *dir == '/' )
             {
-                if ( ABSOLUTE_OK )
+                if ( ABSOLUTE_OK(ctx) )
                 {
-                    if (VERBOSE_ON) debug_print( "WARNING: absolute path: %s", fname );
-                    if (DEBUG_ON) debug_print( "!!absolute path: %s", fname );
+                    if (VERBOSE_ON(ctx)) debug_print( ctx, "WARNING: absolute path: %s", fname );
+                    if (DEBUG_ON(ctx)) debug_print( ctx, "!!absolute path: %s", fname );
                 }
                 else
                 {
-                    if (VERBOSE_ON) debug_print( "WARNING: absolute path stripped: %s", fname );
-                    if (DEBUG_ON) debug_print( "!!absolute path stripped: %s", fname );
+                    if (VERBOSE_ON(ctx)) debug_print( ctx, "WARNING: absolute path stripped: %s", fname );
+                    if (DEBUG_ON(ctx)) debug_print( ctx, "!!absolute path stripped: %s", fname );
 
                     while ( *dir == '/' ) dir++;
 
@@ -383,7 +540,7 @@ munge_fname( const char *fname )
 
     /* cleanup the basename */
 
-    base = sanitize_filename( base );
+    base = sanitize_filename( ctx, base );
 
     /* build a pathname out of the pieces */
 
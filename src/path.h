@@ -26,9 +26,12 @@
 #  include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include "options.h"
+
 extern char * concat_fname (const char* fname1, const char* fname2);
-extern char * munge_fname (const char *fname);
-extern char * find_free_number (const char *fname);
+extern char * munge_fname (TNEF_Context *ctx, const char *fname);
+extern char * find_free_number (TNEF_Context *ctx, const char *fname);
+extern void forget_backup_names (TNEF_Context *ctx);
 extern int file_exists (const char *fname); /* 1 = true, 0 = false */
 
 #endif /* !PATH_H */
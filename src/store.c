@@ -0,0 +1,347 @@
+/*
+ * store.c -- keep one copy of each distinct file
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       With --store=DIR the data of every file goes to DIR/HASH, HASH
+ *       being the XXH64 of the data in hex, and the file itself is made
+ *       a hard link to that.  Logos, signatures and disclaimers which
+ *       come with message after message are then only written once.
+ *
+ *       Objects are written to a temporary name and linked into place,
+ *       so a half written object is never seen and two writers of the
+ *       same object (threads of --batch, or other tnef processes) do
+ *       not get in each other's way.  What has been stored is also
+ *       remembered in an index, so that it is only looked for on disk
+ *       the first time.  A hash and length being the same does not make
+ *       the data the same, so an object is only used once it has been
+ *       read back and compared.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include <errno.h>
+#if HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#if HAVE_PTHREAD_H && HAVE_TLS
+#  include <pthread.h>
+#  define USE_THREADS 1
+#endif
+
+#include "alloc.h"
+#include "path.h"
+#include "store.h"
+#include "util.h"
+
+typedef struct
+{
+    uint64_t hash;
+    size_t len_1;               /* len + 1, 0 for an empty slot */
+} Store_Entry;
+
+struct store
+{
+    char *dir;
+    Store_Entry *index;         /* open addressing, at most half full */
+    size_t size;
+    size_t count;
+    unsigned int counter;       /* for temporary names */
+#if USE_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+#define STORE_INDEX_SIZE 1024
+
+/* The index outlives any one parse, so it comes from malloc rather than
+   from the arena of the parse that happens to add to it */
+static Store_Entry*
+new_index (size_t size)
+{
+    Store_Entry *index = (Store_Entry*)calloc (size, sizeof (Store_Entry));
+    if (index == NULL)
+    {
+        perror ("store");
+        abort ();
+    }
+    return index;
+}
+
+Store*
+store_open (const char *dir)
+{
+    Store *store = XCALLOC (Store, 1);
+
+    if (mkdir (dir, 0777) != 0 && errno != EEXIST)
+    {
+        perror (dir);
+        exit (1);
+    }
+    store->dir = xstrdup (dir);
+    store->size = STORE_INDEX_SIZE;
+    store->index = new_index (store->size);
+#if USE_THREADS
+    pthread_mutex_init (&store->lock, NULL);
+#endif
+    return store;
+}
+
+void
+store_close (Store *store)
+{
+#if USE_THREADS
+    pthread_mutex_destroy (&store->lock);
+#endif
+    free (store->index);
+    XFREE (store->dir);
+    XFREE (store);
+}
+
+const char*
+store_dir (const Store *store)
+{
+    return store->dir;
+}
+
+/* the slot of hash, or the empty one where it would go */
+static Store_Entry*
+index_slot (Store_Entry *index, size_t size, uint64_t hash)
+{
+    size_t i = (size_t)hash & (size - 1);
+
+    while (index[i].len_1 && index[i].hash != hash)
+        i = (i + 1) & (size - 1);
+    return &index[i];
+}
+
+static void
+index_add (Store *store, uint64_t hash, size_t len)
+{
+    Store_Entry *e = index_slot (store->index, store->size, hash);
+
+    if (e->len_1) return;       /* added by another thread meanwhile */
+    e->hash = hash;
+    e->len_1 = len + 1;
+
+    if (++store->count * 2 > store->size)
+    {
+        Store_Entry *old = store->index;
+        size_t old_size = store->size, i;
+
+        store->size *= 2;
+        store->index = new_index (store->size);
+        for (i = 0; i < old_size; i++)
+        {
+            if (old[i].len_1)
+                *index_slot (store->index, store->size, old[i].hash) = old[i];
+        }
+        free (old);
+    }
+}
+
+/* 1 if hash is known with the same len, -1 with a different len, else 0 */
+static int
+index_find (Store *store, uint64_t hash, size_t len)
+{
+    Store_Entry *e;
+    int found;
+
+#if USE_THREADS
+    pthread_mutex_lock (&store->lock);
+#endif
+    e = index_slot (store->index, store->size, hash);
+    found = (e->len_1 == 0) ? 0 : (e->len_1 == len + 1) ? 1 : -1;
+#if USE_THREADS
+    pthread_mutex_unlock (&store->lock);
+#endif
+    return found;
+}
+
+static int
+write_all (int fd, const unsigned char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write (fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int
+read_all (int fd, unsigned char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = read (fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* whether the file path holds the len bytes of data, or if that is NULL
+   those of the file tmp_path */
+static int
+same_data (const char *path, size_t len,
+           const unsigned char *data, const char *tmp_path)
+{
+    unsigned char buf[8192], tmp_buf[8192];
+    int fd = open (path, O_RDONLY);
+    int tmp_fd = -1;
+    int same = (fd >= 0);
+
+    if (same && data == NULL && len > 0)
+    {
+        tmp_fd = open (tmp_path, O_RDONLY);
+        same = (tmp_fd >= 0);
+    }
+    while (same && len > 0)
+    {
+        size_t n = (len < sizeof (buf)) ? len : sizeof (buf);
+
+        if (read_all (fd, buf, n) != 0)
+        {
+            same = 0;
+        }
+        else if (data)
+        {
+            same = (memcmp (buf, data, n) == 0);
+            data += n;
+        }
+        else
+        {
+            same = (read_all (tmp_fd, tmp_buf, n) == 0
+                    && memcmp (buf, tmp_buf, n) == 0);
+        }
+        len -= n;
+    }
+    if (fd >= 0) close (fd);
+    if (tmp_fd >= 0) close (tmp_fd);
+    return same;
+}
+
+/* writes data to a new temporary file in the store, returning its path */
+static char*
+write_tmp (Store *store, const unsigned char *data, size_t len)
+{
+    char name[64];
+    char *path = NULL;
+    int fd;
+
+    do
+    {
+        unsigned int n;
+#if USE_THREADS
+        pthread_mutex_lock (&store->lock);
+#endif
+        n = store->counter++;
+#if USE_THREADS
+        pthread_mutex_unlock (&store->lock);
+#endif
+        sprintf (name, ".tnef-%ld-%u", (long)getpid(), n);
+        XFREE (path);
+        path = concat_fname (store->dir, name);
+        fd = open (path, O_WRONLY|O_CREAT|O_EXCL, 0666);
+    }
+    while (fd < 0 && errno == EEXIST);
+
+    if (fd < 0 || write_all (fd, data, len) != 0 || close (fd) != 0)
+    {
+        perror (path);
+        if (fd >= 0) unlink (path);
+        tnef_exit (1);
+    }
+    return path;
+}
+
+char*
+store_put (Store *store, uint64_t hash, size_t len,
+           const unsigned char *data, const char *tmp_path)
+{
+    char name[17];
+    char *path;
+    char *tmp = NULL;
+    int found = index_find (store, hash, len);
+    struct stat statbuf;
+
+    if (found < 0) return NULL;
+
+    sprintf (name, "%016llx", (unsigned long long)hash);
+    path = concat_fname (store->dir, name);
+    if (found)
+    {
+        if (!same_data (path, len, data, tmp_path))
+        {
+            XFREE (path);
+            return NULL;
+        }
+        if (!data && tmp_path) unlink (tmp_path);
+        return path;
+    }
+
+    if (data || !tmp_path) tmp_path = tmp = write_tmp (store, data, len);
+
+    /* link rather than rename, so that an object is never replaced */
+    if (link (tmp_path, path) != 0)
+    {
+        if (errno != EEXIST)
+        {
+            perror (path);
+            if (tmp) unlink (tmp);
+            tnef_exit (1);
+        }
+        /* there from an earlier run, or from another thread */
+        if (stat (path, &statbuf) != 0 || (size_t)statbuf.st_size != len
+            || !same_data (path, len, data, tmp_path))
+        {
+            if (tmp) unlink (tmp);
+            XFREE (tmp);
+            XFREE (path);
+            return NULL;
+        }
+    }
+    unlink (tmp_path);
+    XFREE (tmp);
+
+#if USE_THREADS
+    pthread_mutex_lock (&store->lock);
+#endif
+    index_add (store, hash, len);
+#if USE_THREADS
+    pthread_mutex_unlock (&store->lock);
+#endif
+    return path;
+}
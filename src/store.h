@@ -0,0 +1,50 @@
+/*
+ * store.h -- keep one copy of each distinct file
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef STORE_H
+#define STORE_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include "xxhash.h"
+
+typedef struct store Store;
+
+/* Opens the store in directory dir, creating it if need be */
+extern Store* store_open (const char *dir);
+extern void store_close (Store *store);
+
+/* Where temporary files to be given to store_put should be made */
+extern const char* store_dir (const Store *store);
+
+/* Makes sure that the len bytes hashing to hash are in the store and
+   returns the (freeable) path of their copy there.  They are data, or
+   if that is NULL the temporary file tmp_path, which is then used up.
+   Returns NULL, leaving tmp_path alone, if different data of the same
+   hash is there already. */
+extern char* store_put (Store *store, uint64_t hash, size_t len,
+                        const unsigned char *data, const char *tmp_path);
+
+#endif /* STORE_H */
@@ -0,0 +1,325 @@
+/*
+ * tar.c -- write extracted files as a tar stream
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       With --tar the files are not created but written one after the
+ *       other as a POSIX (ustar) archive.  A name too long for ustar, or
+ *       a file too large for it, gets a pax extended header first.
+ *       Everything goes straight to the file descriptor with write(2),
+ *       a header and the data of a file at a time.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include <errno.h>
+#include <time.h>
+#if HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#if HAVE_PTHREAD_H && HAVE_TLS
+#  include <pthread.h>
+#  define USE_THREADS 1
+#endif
+
+#include "alloc.h"
+#include "tar.h"
+#include "util.h"
+
+#define TAR_BLOCK 512
+#define TAR_NAME_SIZE 100
+#define TAR_PREFIX_SIZE 155
+#define TAR_MAX_SIZE 077777777777ULL   /* what fits in the size field */
+
+struct tar_output
+{
+    int fd;
+    int failed;                 /* a write failed, the stream is broken */
+    time_t now;                 /* for files without a date */
+#if USE_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+/* the ustar header, see POSIX pax */
+typedef struct
+{
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} Tar_Header;
+
+static const unsigned char zeros[TAR_BLOCK * 2];
+
+Tar_Output*
+tar_open (const char *filename)
+{
+    Tar_Output *tar = XCALLOC (Tar_Output, 1);
+
+    if (strcmp (filename, "-") == 0)
+    {
+        tar->fd = STDOUT_FILENO;
+    }
+    else
+    {
+        tar->fd = open (filename, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+        if (tar->fd < 0)
+        {
+            perror (filename);
+            exit (1);
+        }
+    }
+    tar->now = time (NULL);
+#if USE_THREADS
+    pthread_mutex_init (&tar->lock, NULL);
+#endif
+    return tar;
+}
+
+static int
+write_all (int fd, const void *buf, size_t len)
+{
+    const char *p = (const char*)buf;
+
+    while (len > 0)
+    {
+        ssize_t n = write (fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* v in octal, right aligned and NUL terminated in a field of size */
+static void
+put_octal (char *field, size_t size, unsigned long long v)
+{
+    field[--size] = '\0';
+    while (size > 0)
+    {
+        field[--size] = '0' + (v & 7);
+        v >>= 3;
+    }
+}
+
+/* seconds since the epoch of dt, taken to be UTC */
+static time_t
+date_to_time (const struct date *dt)
+{
+    /* days from civil, after Howard Hinnant */
+    long y = (long)dt->year - (dt->month <= 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long m = dt->month;
+    long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + dt->day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = era * 146097 + doe - 719468;
+
+    return (time_t)days * 86400 + dt->hour * 3600 + dt->min * 60 + dt->sec;
+}
+
+/* an empty header for a member of len bytes, see set_checksum */
+static void
+fill_header (Tar_Header *h, char type, size_t len, time_t mtime)
+{
+    memset (h, '\0', sizeof (Tar_Header));
+    put_octal (h->mode, sizeof (h->mode), 0644);
+    put_octal (h->uid, sizeof (h->uid), 0);
+    put_octal (h->gid, sizeof (h->gid), 0);
+    put_octal (h->size, sizeof (h->size),
+               (len > TAR_MAX_SIZE) ? 0 : (unsigned long long)len);
+    put_octal (h->mtime, sizeof (h->mtime),
+               (mtime < 0) ? 0 : (unsigned long long)mtime);
+    h->typeflag = type;
+    memcpy (h->magic, "ustar", 6);
+    memcpy (h->version, "00", 2);
+}
+
+/* the sum of the bytes of h, with the checksum field taken as spaces */
+static void
+set_checksum (Tar_Header *h)
+{
+    const unsigned char *p = (const unsigned char*)h;
+    unsigned int sum = 0;
+    size_t i;
+
+    memset (h->chksum, ' ', sizeof (h->chksum));
+    for (i = 0; i < sizeof (Tar_Header); i++) sum += p[i];
+    put_octal (h->chksum, 7, sum);
+}
+
+/* Splits name between the prefix and name fields of h, if it can be */
+static int
+split_name (Tar_Header *h, const char *name)
+{
+    size_t len = strlen (name);
+    const char *slash;
+
+    if (len <= TAR_NAME_SIZE)
+    {
+        memcpy (h->name, name, len);
+        return 1;
+    }
+    /* the last '/' that leaves both parts short enough */
+    for (slash = name + len - 1; slash > name; slash--)
+    {
+        if (*slash != '/') continue;
+        if ((size_t)(name + len - slash - 1) > TAR_NAME_SIZE) break;
+        if ((size_t)(slash - name) <= TAR_PREFIX_SIZE)
+        {
+            memcpy (h->prefix, name, slash - name);
+            memcpy (h->name, slash + 1, name + len - slash - 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* appends the pax record "LEN key=value\n" to buf, LEN counting itself */
+static size_t
+pax_record (char *buf, const char *key, const char *value)
+{
+    size_t body = 1 + strlen (key) + 1 + strlen (value) + 1;
+    size_t len = body + 1;
+    char digits[32];
+
+    /* the length includes its own digits */
+    while (len != body + (size_t)sprintf (digits, "%lu", (unsigned long)len))
+        len = body + strlen (digits);
+    return sprintf (buf, "%s %s=%s\n", digits, key, value);
+}
+
+/* writes the header of a file, with a pax header ahead of it when
+   ustar cannot hold its name or size */
+static int
+write_headers (Tar_Output *tar, const char *name, size_t len, time_t mtime)
+{
+    Tar_Header h;
+    int ret = 0;
+
+    fill_header (&h, '0', len, mtime);
+    if (!split_name (&h, name) || len > TAR_MAX_SIZE)
+    {
+        Tar_Header x;
+        char *pax = XMALLOC (char, strlen (name) + 128);
+        size_t pax_len = pax_record (pax, "path", name);
+
+        if (len > TAR_MAX_SIZE)
+        {
+            char size_str[32];
+            sprintf (size_str, "%llu", (unsigned long long)len);
+            pax_len += pax_record (pax + pax_len, "size", size_str);
+        }
+        fill_header (&x, 'x', pax_len, mtime);
+        strcpy (x.name, "PaxHeader");
+        set_checksum (&x);
+        ret = (write_all (tar->fd, &x, sizeof (x)) != 0
+               || write_all (tar->fd, pax, pax_len) != 0
+               || write_all (tar->fd, zeros,
+                             (TAR_BLOCK - pax_len % TAR_BLOCK) % TAR_BLOCK) != 0);
+        XFREE (pax);
+
+        /* as much of the name as fits, for readers without pax */
+        if (!h.name[0]) memcpy (h.name, name, sizeof (h.name));
+    }
+    set_checksum (&h);
+    if (ret == 0) ret = write_all (tar->fd, &h, sizeof (h));
+    return ret;
+}
+
+void
+tar_add (Tar_Output *tar, const char *name,
+         const unsigned char *data, size_t len,
+         const struct date *dt)
+{
+    time_t mtime = tar->now;
+    int failed;
+
+    if (dt && dt->year) mtime = date_to_time (dt);
+
+    /* members are relative, like tar itself makes them */
+    while (*name == '/') name++;
+
+#if USE_THREADS
+    pthread_mutex_lock (&tar->lock);
+#endif
+    failed = tar->failed;
+    if (!failed)
+    {
+        failed = (write_headers (tar, name, len, mtime) != 0
+                  || write_all (tar->fd, data, len) != 0
+                  || write_all (tar->fd, zeros,
+                                (TAR_BLOCK - len % TAR_BLOCK) % TAR_BLOCK) != 0);
+        if (failed) perror ("tar");
+        tar->failed = failed;
+    }
+#if USE_THREADS
+    pthread_mutex_unlock (&tar->lock);
+#endif
+
+    if (failed) tnef_exit (1);
+}
+
+int
+tar_close (Tar_Output *tar)
+{
+    int failed = tar->failed;
+
+    if (!failed && write_all (tar->fd, zeros, sizeof (zeros)) != 0)
+    {
+        perror ("tar");
+        failed = 1;
+    }
+    if (tar->fd != STDOUT_FILENO && close (tar->fd) != 0)
+    {
+        perror ("tar");
+        failed = 1;
+    }
+#if USE_THREADS
+    pthread_mutex_destroy (&tar->lock);
+#endif
+    XFREE (tar);
+    return failed;
+}
@@ -0,0 +1,48 @@
+/*
+ * tar.h -- write extracted files as a tar stream
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef TAR_H
+#define TAR_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include "date.h"
+
+typedef struct tar_output Tar_Output;
+
+/* Starts a tar stream on filename, or stdout if it is "-" */
+extern Tar_Output* tar_open (const char *filename);
+
+/* Adds a file of len bytes named name.  Safe to call from several
+   threads at once, each file goes in whole. */
+extern void tar_add (Tar_Output *tar, const char *name,
+                     const unsigned char *data, size_t len,
+                     const struct date *dt);
+
+/* Ends the stream, returning non-zero if any of it could not be
+   written */
+extern int tar_close (Tar_Output *tar);
+
+#endif /* TAR_H */
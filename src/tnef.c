@@ -32,11 +32,16 @@
 #include "tnef.h"
 
 #include "alloc.h"
+#include "async.h"
 #include "attr.h"
+#include "checksum.h"
 #include "debug.h"
 #include "file.h"
+#include "input.h"
+#include "manifest.h"
 #include "mapi_attr.h"
 #include "options.h"
+#include "output.h"
 #include "path.h"
 #include "rtf.h"
 #include "util.h"
@@ -46,6 +51,7 @@ typedef struct
     VarLenData **text_body;
     VarLenData **html_bodies;
     VarLenData **rtf_bodies;
+    int html_size, rtf_size;
 } MessageBody;
 
 typedef enum
@@ -55,23 +61,83 @@ typedef enum
     RTF = 'r'
 } MessageBodyTypes;
 
-/* Reads and decodes a object from the stream */
-
+/* attATTACHDATA at least this large is streamed to disk rather than
+   read into memory when the input cannot be mapped */
+#ifndef STREAM_THRESHOLD
+#  define STREAM_THRESHOLD (1024 * 1024)
+#endif
+
+/* attachment data is handed to on_attachment_data_chunk in pieces of
+   this size */
+#define REPORT_CHUNK_SIZE (64 * 1024)
+
+/* What the parse in progress holds on to, for parse_file_abandon.
+   Kept off the stack, which is gone by the time that is called. */
+struct parse_state
+{
+    Input in;
+    File *file;                 /* attachment being read */
+    size_t attachments;         /* done so far */
+    MessageBody body;
+    int props_shown;            /* for --props */
+    Attr *attr;                 /* being read */
+    MAPI_Index *index;          /* of attr, being read */
+};
+
+/* Frees the attribute being read, and its MAPI properties */
+static void
+drop_attr (struct parse_state *state)
+{
+    mapi_index_free (state->index);
+    state->index = NULL;
+    if (state->attr)
+    {
+        attr_free (state->attr);
+        XFREE (state->attr);
+    }
+}
+
+/* Reads the header of the next object from the stream */
+
 static Attr*
-read_object (FILE *in)
+read_object (Input *in)
 {
     Attr *attr = NULL;
 
     /* peek to see if there is more to read from this stream */
-    int tmp_char = fgetc(in);
-    if (tmp_char == -1) return NULL;
-    ungetc(tmp_char, in);
+    if (input_peek (in) == EOF) return NULL;
 
-    attr = attr_read (in);
+    attr = attr_read_header (in);
 
     return attr;
 }
 
+/* Should the data of attr go straight to disk instead of into memory?
+   When listing it only needs its checksum verified, which needs no
+   memory either.  A tar member needs its name before its data, so
+   with --tar it is held until the name is known. */
+static int
+stream_attr_data (TNEF_Context *ctx, Input *in, Attr *attr)
+{
+    return (attr->name == attATTACHDATA
+            && attr->lvl_type == LVL_ATTACHMENT
+            && ((attr->len >= STREAM_THRESHOLD && !in->map && !ctx->tar)
+                || LIST_ONLY(ctx))
+            && !DEBUG_ON(ctx));
+}
+
+/* Can the data of attr be skipped altogether?  Listing only needs the
+   length of the attachment data, the name and such are elsewhere. */
+static int
+skip_attr_data (TNEF_Context *ctx, Attr *attr)
+{
+    return (attr->name == attATTACHDATA
+            && attr->lvl_type == LVL_ATTACHMENT
+            && LIST_ONLY(ctx)
+            && !VERIFY_CHECKSUMS(ctx)
+            && !DEBUG_ON(ctx));
+}
+
 static void
 free_bodies(VarLenData **bodies, int len)
 {
@@ -139,9 +205,9 @@ get_body_files (const char* filename,
             files[i]->name = tmp;
             files[i]->mime_type = mime;
             files[i]->len = data[i]->len;
-            files[i]->data
-                = CHECKED_XMALLOC(unsigned char, data[i]->len);
-            memmove (files[i]->data, data[i]->data, data[i]->len);
+            files[i]->data = data[i]->data;   /* freed with the bodies */
+            files[i]->borrowed = 1;
+            files[i]->body_type = pref;
         }
     }
     return files;
@@ -177,48 +243,41 @@ get_html_data (MAPI_Attr *a)
     return body;
 }
 
-int
-data_left (FILE* input_file)
+static int
+data_left (TNEF_Context *ctx, Input* in)
 {
     int retval = 1;
+    size_t data_left;
 
-    if (feof(input_file)) retval = 0;
-    else if (input_file != stdin)
+    if (input_at_eof (in)) retval = 0;
+    else if (input_remaining (in, &data_left))
     {
         /* check if there is enough data left */
-        struct stat statbuf;
-        size_t pos, data_left;
-        fstat (fileno(input_file), &statbuf);
-        pos = ftell(input_file);
-        data_left = (statbuf.st_size - pos);
-
         if (data_left > 0 && data_left < MINIMUM_ATTR_LENGTH)
         {
-            if ( CRUFT_SKIP )
+            if ( CRUFT_SKIP(ctx) )
             {
                 /* look for specific flavor of cruft -- trailing "\r\n" */
 
                 if ( data_left == 2 )
                 {
-                    int c = fgetc( input_file );
+                    int c = input_peek( in );
 
                     if ( c < 0 )	/* this should never happen */
                     {
                         fprintf( stderr, "ERROR: confused beyond all redemption.\n" );
-                        exit (1);
+                        tnef_exit (1);
                     }
 
-                    ungetc( c, input_file );
-
                     if ( c == 0x0d )		/* test for "\r" part of "\r\n" */
                     {
                         /* "trust" that next char is 0x0a and ignore this cruft */
 
-                        if ( VERBOSE_ON )
+                        if ( VERBOSE_ON(ctx) )
                             fprintf( stderr, "WARNING: garbage at end of file (ignored)\n" );
 
-                        if ( DEBUG_ON )
-                            debug_print( "!!garbage at end of file (ignored)\n" );
+                        if ( DEBUG_ON(ctx) )
+                            debug_print( ctx, "!!garbage at end of file (ignored)\n" );
                     }
                     else
                     {
@@ -242,55 +301,439 @@ data_left (FILE* input_file)
 }
 
 
-/* The entry point into this module.  This parses an entire TNEF file. */
-int
-parse_file (FILE* input_file, char* directory,
-            char *body_filename, char *body_pref,
-            int flags)
+/* Gives up on the parse because a libtnef callback asked to */
+static void
+stop_parse (TNEF_Context *ctx)
+{
+    ctx->stopped = 1;
+    tnef_exit (1);
+}
+
+static void
+report_attribute (TNEF_Context *ctx, Attr *attr)
+{
+    const TNEF_Callbacks *cb = ctx->callbacks;
+    TNEF_Attribute a;
+
+    if (cb->on_attribute == NULL) return;
+
+    a.level = (attr->lvl_type == LVL_MESSAGE
+               ? TNEF_LEVEL_MESSAGE : TNEF_LEVEL_ATTACHMENT);
+    a.name = attr->name;
+    a.type = attr->type;
+    a.data.data = attr->buf;
+    a.data.len = attr->len;
+
+    if (cb->on_attribute (cb->user_data, &a) != 0) stop_parse (ctx);
+}
+
+/* Length of a string decoded into len bytes, which take in its
+   terminating NUL and what followed it */
+static size_t
+string_len (const unsigned char *s, size_t len)
+{
+    const unsigned char *end = memchr (s, '\0', len);
+    return end ? (size_t)(end - s) : len;
+}
+
+/* Points spans at the n values, which are either strings or binary
+   data or fixed size numbers kept in the value itself */
+static TNEF_Span*
+make_value_spans (MAPI_Attr *a)
+{
+    TNEF_Span *spans = XCALLOC (TNEF_Span, a->num_values + 1);
+    size_t i;
+
+    for (i = 0; i < a->num_values; i++)
+    {
+        MAPI_Value *v = &a->values[i];
+
+        switch (a->type)
+        {
+        case szMAPI_STRING:
+        case szMAPI_UNICODE_STRING:
+            spans[i].data = v->data.buf;
+            spans[i].len = string_len (v->data.buf, v->len);
+            break;
+        case szMAPI_OBJECT:
+        case szMAPI_BINARY:
+            spans[i].data = v->data.buf;
+            spans[i].len = v->len;
+            break;
+        default:
+            spans[i].data = (unsigned char*)&v->data;
+            spans[i].len = v->len;
+            break;
+        }
+    }
+    return spans;
+}
+
+static void
+report_mapi_attr (TNEF_Context *ctx, TNEF_Level level, MAPI_Attr *a)
+{
+    const TNEF_Callbacks *cb = ctx->callbacks;
+    TNEF_Property prop;
+    TNEF_Span *names = NULL;
+    TNEF_Span *values;
+    size_t j;
+    int stop;
+
+    if (cb->on_mapi_property == NULL) return;
+
+    if (a->num_names)
+    {
+        names = XCALLOC (TNEF_Span, a->num_names);
+        for (j = 0; j < a->num_names; j++)
+        {
+            names[j].data = a->names[j].data;
+            names[j].len = string_len (a->names[j].data, a->names[j].len);
+        }
+    }
+    values = make_value_spans (a);
+
+    prop.level = level;
+    prop.name = a->name;
+    prop.type = a->type;
+    prop.num_values = a->num_values;
+    prop.values = values;
+    prop.num_names = a->num_names;
+    prop.names = names;
+
+    stop = cb->on_mapi_property (cb->user_data, &prop);
+    XFREE (values);
+    XFREE (names);
+    if (stop != 0) stop_parse (ctx);
+}
+
+/* libtnef callers and --debug see every property, so all of index is
+   decoded for them, in order */
+static void
+decode_mapi_props (TNEF_Context *ctx, TNEF_Level level, MAPI_Index *index)
+{
+    size_t i;
+
+    if (ctx->callbacks == NULL && !DEBUG_ON(ctx)) return;
+
+    for (i = 0; i < index->num_props; i++)
+    {
+        MAPI_Attr *a = mapi_index_decode (ctx, index, &index->props[i]);
+        if (ctx->callbacks) report_mapi_attr (ctx, level, a);
+    }
+}
+
+/* Hands len bytes at data to on_attachment_data_chunk a piece at a
+   time, returning their checksum */
+static uint16
+report_attachment_data (TNEF_Context *ctx, unsigned char *data, size_t len)
+{
+    const TNEF_Callbacks *cb = ctx->callbacks;
+    uint16 sum = 0;
+    size_t done = 0;
+
+    while (done < len)
+    {
+        TNEF_Span chunk;
+        size_t n = len - done;
+        if (n > REPORT_CHUNK_SIZE) n = REPORT_CHUNK_SIZE;
+
+        sum = checksum16 (sum, data + done, n);
+        if (cb->on_attachment_data_chunk)
+        {
+            chunk.data = data + done;
+            chunk.len = n;
+            if (cb->on_attachment_data_chunk (cb->user_data, &chunk) != 0)
+                stop_parse (ctx);
+        }
+        done += n;
+    }
+    return sum;
+}
+
+/* Reads the data of attr, an attATTACHDATA whose header has just been
+   read, reporting it as it goes.  It stays in the input, which is
+   always in memory for libtnef. */
+static void
+read_attachment_data (TNEF_Context *ctx, Input *in, Attr *attr)
+{
+    uint16 sum;
+
+    attr->buf = input_view (in, attr->len);
+    attr->borrowed = 1;
+
+    sum = report_attachment_data (ctx, attr->buf, attr->len);
+    if (geti16 (in) != sum) attr_checksum_failed (ctx);
+}
+
+static void
+report_attachment_begin (TNEF_Context *ctx)
+{
+    const TNEF_Callbacks *cb = ctx->callbacks;
+
+    if (cb->on_attachment_begin
+        && cb->on_attachment_begin (cb->user_data) != 0)
+        stop_parse (ctx);
+}
+
+/* Hands a completed attachment to the libtnef caller */
+static void
+report_attachment_end (TNEF_Context *ctx, File *file)
+{
+    const TNEF_Callbacks *cb = ctx->callbacks;
+    TNEF_Attachment att;
+
+    if (cb->on_attachment_end == NULL) return;
+
+    memset (&att, '\0', sizeof (TNEF_Attachment));
+    att.name = file->name;
+    att.mime_type = file->mime_type;
+    att.content_id = file->content_id;
+    att.date.year = file->dt.year;
+    att.date.month = file->dt.month;
+    att.date.day = file->dt.day;
+    att.date.hour = file->dt.hour;
+    att.date.min = file->dt.min;
+    att.date.sec = file->dt.sec;
+    att.data.data = file->data;
+    att.data.len = file->len;
+
+    if (cb->on_attachment_end (cb->user_data, &att) != 0) stop_parse (ctx);
+}
+
+static void
+report_bodies (TNEF_Context *ctx, TNEF_Body_Type type, VarLenData **bodies)
+{
+    const TNEF_Callbacks *cb = ctx->callbacks;
+    int i;
+
+    if (bodies == NULL || cb->on_body == NULL) return;
+
+    for (i = 0; bodies[i]; i++)
+    {
+        TNEF_Span span;
+        span.data = bodies[i]->data;
+        span.len = bodies[i]->len;
+        if (cb->on_body (cb->user_data, type, &span) != 0) stop_parse (ctx);
+    }
+}
+
+/* Adds the MAPI properties in attr to file, reporting them and any
+   attachment data they hold on the way */
+static void
+add_attachment_props (TNEF_Context *ctx, File *file, Attr *attr)
+{
+    MAPI_Index *index = mapi_index_read (ctx, attr->len, attr->buf,
+                                         &ctx->state->index);
+    unsigned char *data;
+
+    if (index == NULL) return;
+
+    assert (file);
+    data = file->data;
+    decode_mapi_props (ctx, TNEF_LEVEL_ATTACHMENT, index);
+    file_add_mapi_attrs (ctx, file, index, attr->borrowed);
+    if (ctx->callbacks && file->data != data)
+        (void)report_attachment_data (ctx, file->data, file->len);
+}
+
+/* Writes out, or for libtnef reports, a completed attachment */
+static void
+attachment_done (TNEF_Context *ctx, File *file, const char *directory)
+{
+    ctx->state->attachments++;
+    if (ctx->callbacks)
+    {
+        report_attachment_end (ctx, file);
+    }
+    else
+    {
+        /* data left in the mapping can be copied by the kernel */
+        if (file->borrowed)
+            file->in_file = input_file_range (&ctx->state->in,
+                                              file->data, file->len,
+                                              &file->in_fd, &file->in_offset);
+        file_write (ctx, file, directory);
+    }
+}
+
+/* Records whether the data of file, just read, had a good checksum.
+   errors is ctx->checksum_errors from before it was read. */
+static void
+note_checksum (TNEF_Context *ctx, File *file, unsigned int errors)
+{
+    file->checksum = ((ctx->checksum_errors == errors)
+                      ? DATA_OK : DATA_CORRUPT);
+}
+
+static void
+describe_message (TNEF_Context *ctx, struct parse_state *state, int is_tnef)
+{
+    Manifest_Message msg;
+
+    msg.is_tnef = is_tnef;
+    msg.attachments = state->attachments;
+    msg.has_text = (state->body.text_body != NULL);
+    msg.has_html = (state->body.html_size > 0);
+    msg.has_rtf = (state->body.rtf_size > 0);
+    msg.error = NULL;
+    manifest_message (ctx, &msg);
+}
+
+/* The message could not be parsed to the end, why has gone to stderr */
+static void
+describe_failure (TNEF_Context *ctx)
+{
+    Manifest_Message msg;
+
+    memset (&msg, '\0', sizeof (msg));
+    msg.error = "parse failed";
+    manifest_message (ctx, &msg);
+}
+
+static void
+save_bodies (TNEF_Context *ctx, MessageBody *body,
+             const char *directory,
+             char *body_filename, char *body_pref)
+{
+    int i = 0;
+    int all_flag = 0;
+
+    if (ctx->callbacks)
+    {
+        report_bodies (ctx, TNEF_BODY_TEXT, body->text_body);
+        report_bodies (ctx, TNEF_BODY_HTML, body->html_bodies);
+        report_bodies (ctx, TNEF_BODY_RTF, body->rtf_bodies);
+        return;
+    }
+
+    if (!(ctx->flags & SAVEBODY)) return;
+
+    if (strcmp (body_pref, "all") == 0)
+    {
+        all_flag = 1;
+        body_pref = "rht";
+    }
+
+    for (; i < 3; i++)
+    {
+        File **files
+            = get_body_files (body_filename, body_pref[i], body);
+        if (files)
+        {
+            int j = 0;
+            for (; files[j]; j++)
+            {
+                file_write (ctx, files[j], directory);
+                file_free (files[j]);
+                XFREE(files[j]);
+            }
+            XFREE(files);
+            if (!all_flag) break;
+        }
+    }
+}
+
+static void
+free_message_body (MessageBody *body)
+{
+    if (body->text_body)
+    {
+        free_bodies(body->text_body, 1);
+        XFREE(body->text_body);
+    }
+    if (body->rtf_size > 0)
+    {
+        free_bodies(body->rtf_bodies, body->rtf_size);
+        XFREE(body->rtf_bodies);
+    }
+    if (body->html_size > 0)
+    {
+        free_bodies(body->html_bodies, body->html_size);
+        XFREE(body->html_bodies);
+    }
+}
+
+/* Parses the TNEF stream in state->in, which has been opened */
+static int
+parse_stream (TNEF_Context *ctx, struct parse_state *state,
+              char* directory, char *body_filename, char *body_pref)
 {
     uint32 d;
     uint16 key;
+    Input *in = &state->in;
+    MessageBody *body = &state->body;
     Attr *attr = NULL;
-    File *file = NULL;
-    int rtf_size = 0, html_size = 0;
-    MessageBody body;
-    memset (&body, '\0', sizeof (MessageBody));
-
-    /* store the program options in our file global variables */
-    g_flags = flags;
+    unsigned int errors;
 
     /* check that this is in fact a TNEF file */
-    d = geti32(input_file);
+    d = geti32(in);
     if (d != TNEF_SIGNATURE)
     {
-        fprintf (stdout, "Seems not to be a TNEF file\n");
+        if (JSON_OUT(ctx))
+            describe_message (ctx, state, 0);
+        else
+            fprintf ((ctx->tar ? stderr : stdout),
+                     "Seems not to be a TNEF file\n");
         return 1;
     }
 
     /* Get the key */
-    key = geti16(input_file);
-    debug_print ("TNEF Key: %hx\n", key);
+    key = geti16(in);
+    debug_print (ctx, "TNEF Key: %hx\n", key);
 
     /* The rest of the file is a series of 'messages' and 'attachments' */
-    while ( data_left( input_file ) )
+    while ( data_left( ctx, in ) )
     {
-        attr = read_object( input_file );
+        attr = state->attr = read_object( in );
 
         if ( attr == NULL ) break;
 
+        if (state->file && skip_attr_data (ctx, attr))
+        {
+            file_skip_data (state->file, in, attr);
+            drop_attr (state);
+            continue;
+        }
+        errors = ctx->checksum_errors;
+        if (state->file && stream_attr_data (ctx, in, attr))
+        {
+            file_stream_data (ctx, state->file, in, attr, directory);
+            note_checksum (ctx, state->file, errors);
+            drop_attr (state);
+            continue;
+        }
+        if (ctx->callbacks && state->file
+            && attr->name == attATTACHDATA
+            && attr->lvl_type == LVL_ATTACHMENT)
+        {
+            read_attachment_data (ctx, in, attr);
+        }
+        else
+        {
+            attr_read_data (ctx, in, attr);
+        }
+        if (state->file
+            && attr->name == attATTACHDATA
+            && attr->lvl_type == LVL_ATTACHMENT)
+        {
+            note_checksum (ctx, state->file, errors);
+        }
+
         /* This signals the beginning of a file */
         if (attr->name == attATTACHRENDDATA)
         {
-            if (file)
+            if (state->file)
             {
-                file_write (file, directory);
-                file_free (file);
+                attachment_done (ctx, state->file, directory);
+                file_free (state->file);
             }
             else
             {
-                file = CHECKED_XCALLOC (File, 1);
+                state->file = CHECKED_XCALLOC (File, 1);
             }
+            if (ctx->callbacks) report_attachment_begin (ctx);
         }
+        if (ctx->callbacks) report_attribute (ctx, attr);
 
         /* Add the data to our lists. */
         switch (attr->lvl_type)
@@ -298,102 +741,161 @@ parse_file (FILE* input_file, char* directory,
         case LVL_MESSAGE:
             if (attr->name == attBODY)
             {
-                body.text_body = get_text_data (attr);
+                body->text_body = get_text_data (attr);
             }
             else if (attr->name == attMAPIPROPS)
             {
-                MAPI_Attr **mapi_attrs
-                    = mapi_attr_read (attr->len, attr->buf);
-                if (mapi_attrs)
+                MAPI_Index *index
+                    = mapi_index_read (ctx, attr->len, attr->buf,
+                                       &state->index);
+                if (index)
                 {
-                    int i;
-                    for (i = 0; mapi_attrs[i]; i++)
+                    size_t i;
+                    decode_mapi_props (ctx, TNEF_LEVEL_MESSAGE, index);
+                    if (ctx->props)
+                    {
+                        manifest_properties (ctx, index);
+                        state->props_shown = 1;
+                    }
+                    for (i = 0; i < index->num_props; i++)
                     {
-                        MAPI_Attr *a = mapi_attrs[i];
+                        MAPI_Prop *p = &index->props[i];
+                        MAPI_Attr *a;
 
-                        if (a->type == szMAPI_BINARY && a->name == MAPI_BODY_HTML)
+                        if (p->type != szMAPI_BINARY) continue;
+                        if (p->name == MAPI_BODY_HTML)
                         {
-                            body.html_bodies = get_html_data (a);
-                                html_size = a->num_values;
+                            a = mapi_index_decode (ctx, index, p);
+                            body->html_bodies = get_html_data (a);
+                                body->html_size = a->num_values;
                         }
-                        else if (a->type == szMAPI_BINARY && a->name == MAPI_RTF_COMPRESSED)
+                        else if (p->name == MAPI_RTF_COMPRESSED)
                         {
-                            body.rtf_bodies = get_rtf_data (a);
-                                rtf_size = a->num_values;
+                            a = mapi_index_decode (ctx, index, p);
+                            body->rtf_bodies = get_rtf_data (a);
+                                body->rtf_size = a->num_values;
                         }
                     }
                     /* cannot save attributes to file, since they
                      * are not attachment attributes */
                     /* file_add_mapi_attrs (file, mapi_attrs); */
-                    mapi_attr_free_list (mapi_attrs);
-                    XFREE (mapi_attrs);
                 }
             }
             break;
         case LVL_ATTACHMENT:
-            file_add_attr (file, attr);
+            if (attr->name == attATTACHMENT)
+            {
+                add_attachment_props (ctx, state->file, attr);
+            }
+            else
+            {
+                file_add_attr (state->file, attr);
+            }
             break;
         default:
             fprintf (stderr, "Invalid lvl type on attribute: %d\n",
                      attr->lvl_type);
+            if (JSON_OUT(ctx)) describe_failure (ctx);
             return 1;
             break;
         }
-        attr_free (attr);
-        XFREE (attr);
+        drop_attr (state);
     }
 
-    if (file)
+    if (state->file)
     {
-        file_write (file, directory);
-        file_free (file);
-        XFREE (file);
+        attachment_done (ctx, state->file, directory);
+        file_free (state->file);
+        XFREE (state->file);
     }
 
     /* Write the message body */
-    if (flags & SAVEBODY)
-    {
-        int i = 0;
-        int all_flag = 0;
-        if (strcmp (body_pref, "all") == 0)
-        {
-            all_flag = 1;
-            body_pref = "rht";
-        }
+    save_bodies (ctx, body, directory, body_filename, body_pref);
+    file_write_finish (ctx);
+    if (ctx->props && !state->props_shown) manifest_properties (ctx, NULL);
+    if (JSON_OUT(ctx)) describe_message (ctx, state, 1);
+    return 0;
+}
 
-        for (; i < 3; i++)
-        {
-            File **files
-                = get_body_files (body_filename, body_pref[i], &body);
-            if (files)
-            {
-                int j = 0;
-                for (; files[j]; j++)
-                {
-                    file_write(files[j], directory);
-                    file_free (files[j]);
-                    XFREE(files[j]);
-                }
-                XFREE(files);
-                if (!all_flag) break;
-            }
-        }
-    }
+/* Starts a parse of what has been opened with input_open* */
+static struct parse_state*
+begin_parse (TNEF_Context *ctx)
+{
+    struct parse_state *state;
 
-    if (body.text_body)
-    {
-        free_bodies(body.text_body, 1);
-        XFREE(body.text_body);
-    }
-    if (rtf_size > 0)
-    {
-        free_bodies(body.rtf_bodies, rtf_size);
-        XFREE(body.rtf_bodies);
-    }
-    if (html_size > 0)
+    set_alloc_limit (ctx->alloc_limit);
+
+    /* everything small allocated from here on is gone on return */
+    alloc_arena_begin ();
+    state = XCALLOC (struct parse_state, 1);
+    ctx->state = state;
+    return state;
+}
+
+/* Releases what a parse held on to, however it ended */
+static void
+end_parse (TNEF_Context *ctx)
+{
+    struct parse_state *state = ctx->state;
+
+    /* a parse given up on still has to wait for what it has written,
+       which uses the input and the memory about to go */
+    if (ctx->writes) async_wait (ctx->async, &ctx->writes);
+
+    drop_attr (state);
+    if (state->file)
     {
-        free_bodies(body.html_bodies, html_size);
-        XFREE(body.html_bodies);
+        file_free (state->file);
+        XFREE (state->file);
     }
-    return 0;
+    free_message_body (&state->body);
+    input_close (&state->in);
+    forget_backup_names (ctx);
+    output_close (ctx->output);
+    ctx->output = NULL;
+    ctx->state = NULL;
+    alloc_arena_end ();
+}
+
+/* The entry point into this module.  This parses an entire TNEF file. */
+int
+parse_file (TNEF_Context *ctx, FILE* input_file, char* directory,
+            char *body_filename, char *body_pref)
+{
+    struct parse_state *state = begin_parse (ctx);
+    int ret;
+
+    input_open (&state->in, input_file);
+    ret = parse_stream (ctx, state, directory, body_filename, body_pref);
+    end_parse (ctx);
+    return ret;
+}
+
+/* As parse_file but on len bytes in memory, reporting what is found
+   through ctx->callbacks rather than writing files */
+int
+parse_buffer (TNEF_Context *ctx, const void *buf, size_t len)
+{
+    struct parse_state *state = begin_parse (ctx);
+    int ret;
+
+    input_open_buffer (&state->in, buf, len);
+    ret = parse_stream (ctx, state, NULL, NULL, NULL);
+    end_parse (ctx);
+    return ret;
+}
+
+/* Releases what parse_file held on to when it was interrupted by
+   tnef_exit, including the temporary file of an attachment being
+   streamed, and ends the --json description of the message.  Does
+   nothing if parse_file returned normally. */
+void
+parse_file_abandon (TNEF_Context *ctx)
+{
+    if (ctx->state == NULL) return;
+
+    end_parse (ctx);
+    /* after what was still being written has been described; tnef_exit
+       is never called with stdout locked for a manifest object */
+    if (JSON_OUT(ctx)) describe_failure (ctx);
 }
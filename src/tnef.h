@@ -29,14 +29,20 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "common.h"
+#include "options.h"
 
 /* TNEF signature.  Equivalent to the magic cookie for a TNEF file. */
 #define TNEF_SIGNATURE   0x223e9f78
 
 /* Main entrance point to tnef processing */
 extern int
-parse_file(FILE *input, char * output_dir,
-           char *body_file, char *body_pref,
-           int flags);
+parse_file(TNEF_Context *ctx, FILE *input, char * output_dir,
+           char *body_file, char *body_pref);
+
+/* As parse_file, reporting to ctx->callbacks instead of writing files */
+extern int parse_buffer (TNEF_Context *ctx, const void *buf, size_t len);
+
+/* Cleans up after a parse_file cut short by tnef_exit */
+extern void parse_file_abandon (TNEF_Context *ctx);
 
 #endif /* !TNEF_H */
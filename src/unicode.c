@@ -0,0 +1,322 @@
+/*
+ * unicode.c -- UTF-16LE to UTF-8 conversion
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       MAPI strings are mostly ASCII, so the conversion hands runs
+ *       of ASCII code units to a kernel copying them 16 or 32 at a time
+ *       where SIMD is available.  Calling it only pays for itself on a
+ *       long enough run, so a scalar loop does everything else: strings
+ *       too short for the kernel, the tail of the string, and text with
+ *       so little ASCII between the other characters that the kernel
+ *       keeps stopping short.  The output is allocated for the worst
+ *       case and shrunk afterwards rather than being sized by a pass of
+ *       its own.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#if HAVE_STDINT_H
+#  include <stdint.h>
+#endif
+
+#if HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif
+
+#include "alloc.h"
+#include "unicode.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && HAVE_IMMINTRIN_H
+#  include <immintrin.h>
+#  define UNICODE_X86 1
+#endif
+
+#define UNIT(p) ((uint32)(p)[0] | ((uint32)(p)[1] << 8))
+
+/* the kernel is only called with at least this many units left */
+#define ASCII_RUN_MIN 32
+/* nor for this many units after it stops short of that, twice as many
+   each time it does so again */
+#define ASCII_RUN_BACKOFF 64
+#define ASCII_RUN_BACKOFF_MAX 4096
+/* the output is only shrunk when it would give back this much */
+#define ASCII_SHRINK_MIN 256
+
+#define IS_HIGH_SURROGATE(c) (((c) & 0xfc00) == 0xd800)
+#define IS_LOW_SURROGATE(c) (((c) & 0xfc00) == 0xdc00)
+
+/* The bits of four units which are clear when all of them are ASCII,
+   as a uint64_t whatever the byte order of the host */
+static const unsigned char non_ascii_bytes[8] =
+    { 0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff };
+
+/* reference implementation */
+static size_t
+ascii_run_byte (const unsigned char *src, size_t n, unsigned char *dst)
+{
+    size_t i;
+
+    for (i = 0; i < n && src[2*i+1] == 0 && src[2*i] < 0x80; i++)
+    {
+        if (dst) dst[i] = src[2*i];
+    }
+    return i;
+}
+
+/* Portable version testing 4 units at a time */
+static size_t
+ascii_run_word (const unsigned char *src, size_t n, unsigned char *dst)
+{
+    uint64_t non_ascii;
+    size_t i = 0;
+
+    memcpy (&non_ascii, non_ascii_bytes, sizeof (non_ascii));
+    while (i + 4 <= n)
+    {
+        uint64_t w;
+        memcpy (&w, src + 2*i, sizeof (w));
+        if (w & non_ascii) break;
+        if (dst)
+        {
+            dst[i+0] = src[2*i+0];
+            dst[i+1] = src[2*i+2];
+            dst[i+2] = src[2*i+4];
+            dst[i+3] = src[2*i+6];
+        }
+        i += 4;
+    }
+    return i + ascii_run_byte (src + 2*i, n - i, dst ? dst + i : NULL);
+}
+
+static int
+always_usable (void)
+{
+    return 1;
+}
+
+#if UNICODE_X86
+
+/* A unit is ASCII when none of the bits in 0xff80 are set; ASCII units
+   can then be narrowed to bytes with an unsigned saturating pack. */
+
+__attribute__((target("sse2")))
+static size_t
+ascii_run_sse2 (const unsigned char *src, size_t n, unsigned char *dst)
+{
+    const __m128i non_ascii = _mm_set1_epi16 ((short)0xff80);
+    size_t i = 0;
+
+    while (i + 16 <= n)
+    {
+        __m128i a = _mm_loadu_si128 ((const __m128i*)(src + 2*i));
+        __m128i b = _mm_loadu_si128 ((const __m128i*)(src + 2*i + 16));
+        __m128i t = _mm_and_si128 (_mm_or_si128 (a, b), non_ascii);
+        if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (t, _mm_setzero_si128 ()))
+            != 0xffff)
+            break;
+        if (dst)
+            _mm_storeu_si128 ((__m128i*)(dst + i), _mm_packus_epi16 (a, b));
+        i += 16;
+    }
+    return i + ascii_run_word (src + 2*i, n - i, dst ? dst + i : NULL);
+}
+
+__attribute__((target("avx2")))
+static size_t
+ascii_run_avx2 (const unsigned char *src, size_t n, unsigned char *dst)
+{
+    const __m256i non_ascii = _mm256_set1_epi16 ((short)0xff80);
+    size_t i = 0;
+
+    while (i + 32 <= n)
+    {
+        __m256i a = _mm256_loadu_si256 ((const __m256i*)(src + 2*i));
+        __m256i b = _mm256_loadu_si256 ((const __m256i*)(src + 2*i + 32));
+        __m256i t = _mm256_and_si256 (_mm256_or_si256 (a, b), non_ascii);
+        if (!_mm256_testz_si256 (t, t)) break;
+        if (dst)
+        {
+            /* the pack works within 128 bit lanes, put them in order */
+            __m256i p = _mm256_packus_epi16 (a, b);
+            _mm256_storeu_si256 ((__m256i*)(dst + i),
+                                 _mm256_permute4x64_epi64 (p, 0xd8));
+        }
+        i += 32;
+    }
+    /* avoid the AVX to SSE transition penalty in the scalar tail */
+    _mm256_zeroupper ();
+    return i + ascii_run_word (src + 2*i, n - i, dst ? dst + i : NULL);
+}
+
+static int
+sse2_usable (void)
+{
+    return __builtin_cpu_supports ("sse2");
+}
+
+static int
+avx2_usable (void)
+{
+    return __builtin_cpu_supports ("avx2");
+}
+
+#endif /* UNICODE_X86 */
+
+/* slowest first; the last usable one is used */
+const Ascii_Run_Kernel ascii_run_kernels[] =
+{
+    { "byte", ascii_run_byte, always_usable },
+    { "word", ascii_run_word, always_usable },
+#if UNICODE_X86
+    { "sse2", ascii_run_sse2, sse2_usable },
+    { "avx2", ascii_run_avx2, avx2_usable },
+#endif /* UNICODE_X86 */
+    { NULL, NULL, NULL }
+};
+
+static ascii_run_fn best = NULL;
+
+static void
+pick_kernel (void)
+{
+    int i;
+
+    for (i = 0; ascii_run_kernels[i].name; i++)
+    {
+        if (ascii_run_kernels[i].usable ()) best = ascii_run_kernels[i].fn;
+    }
+}
+
+#if HAVE_PTHREAD_H
+static pthread_once_t pick_once = PTHREAD_ONCE_INIT;
+#  define PICK_KERNEL() pthread_once (&pick_once, pick_kernel)
+#else
+#  define PICK_KERNEL() do { if (best == NULL) pick_kernel (); } while (0)
+#endif /* HAVE_PTHREAD_H */
+
+static ascii_run_fn
+ascii_run (void)
+{
+    PICK_KERNEL ();
+    return best;
+}
+
+unsigned char*
+unicode_to_utf8 (size_t len, unsigned char *buf, size_t *utf8_len)
+{
+    size_t n = len / 2;
+    size_t j;
+    const unsigned char *src = buf;
+    const unsigned char *end = buf + 2*n;
+    /* looked up the first time it is needed */
+    ascii_run_fn run = NULL;
+    /* the unit at which the kernel may next be tried */
+    size_t next_run = (n >= ASCII_RUN_MIN) ? 0 : n;
+    size_t backoff = ASCII_RUN_BACKOFF;
+    /* no unit takes more than 3 bytes, nor a pair of them more than 4 */
+    unsigned char *utf8 = (unsigned char*)xmalloc (n, 3, 1);
+    unsigned char *dst = utf8;
+
+    while (src < end)
+    {
+        const unsigned char *stop = buf + 2*next_run;
+        uint64_t w[2], non_ascii;
+        size_t ascii = 0;
+
+        /* one unit at a time up to there */
+        while (src < stop)
+        {
+            uint32 c = UNIT (src);
+
+            if (c <= 0x7f)
+            {
+                *dst++ = (unsigned char)c;
+                src += 2;
+            }
+            else if (c <= 0x7ff)
+            {
+                *dst++ = 0xc0 | (c >> 6);
+                *dst++ = 0x80 | (c & 0x3f);
+                src += 2;
+            }
+            else if (!IS_HIGH_SURROGATE (c) || end - src == 2
+                     || !IS_LOW_SURROGATE (UNIT (src + 2)))
+            {
+                /* unpaired surrogates included */
+                *dst++ = 0xe0 | (c >> 12);
+                *dst++ = 0x80 | ((c >> 6) & 0x3f);
+                *dst++ = 0x80 | (c & 0x3f);
+                src += 2;
+            }
+            else
+            {
+                c = 0x10000 + ((c - 0xd800) << 10) + (UNIT (src + 2) - 0xdc00);
+                *dst++ = 0xf0 | (c >> 18);
+                *dst++ = 0x80 | ((c >> 12) & 0x3f);
+                *dst++ = 0x80 | ((c >> 6) & 0x3f);
+                *dst++ = 0x80 | (c & 0x3f);
+                src += 4;
+            }
+        }
+        if (src >= end) break;
+
+        /* the kernel is only worth calling if the next few are ASCII */
+        memcpy (&non_ascii, non_ascii_bytes, sizeof (non_ascii));
+        memcpy (w, src, sizeof (w));
+        if (((w[0] | w[1]) & non_ascii) == 0)
+        {
+            if (run == NULL) run = ascii_run ();
+            ascii = run (src, (end - src) / 2, dst);
+            src += 2*ascii;
+            dst += ascii;
+        }
+        next_run = (src - buf) / 2;
+        if (ascii >= ASCII_RUN_MIN)
+        {
+            /* try again after what stopped it */
+            backoff = ASCII_RUN_BACKOFF;
+            next_run++;
+        }
+        else
+        {
+            /* the text is not one the kernel helps with */
+            next_run += backoff;
+            if (backoff < ASCII_RUN_BACKOFF_MAX) backoff *= 2;
+        }
+        if (next_run + ASCII_RUN_MIN > n) next_run = n;
+    }
+    *dst = '\0';
+    j = dst - utf8;
+
+    /* --maxsize is for what is kept, not for the worst case */
+    if (get_alloc_limit () && j > get_alloc_limit ())
+    {
+        XFREE (utf8);
+        alloc_limit_assert ("unicode_to_utf8", j);
+    }
+    /* not worth a realloc for a little */
+    if (3 * n - j >= ASCII_SHRINK_MIN) utf8 = xshrink (utf8, j + 1);
+    if (utf8_len) *utf8_len = j;
+    return utf8;
+}
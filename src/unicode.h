@@ -0,0 +1,56 @@
+/*
+ * unicode.h -- UTF-16LE to UTF-8 conversion
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef UNICODE_H
+#define UNICODE_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+/* Converts the leading run of ASCII code units in src (n units of
+   UTF-16LE) to dst, or just counts them when dst is NULL.  Returns the
+   number of units in the run. */
+typedef size_t (*ascii_run_fn) (const unsigned char *src, size_t n,
+                                unsigned char *dst);
+
+/* An implementation of the ASCII fast path, see ascii_run_kernels */
+typedef struct
+{
+    const char *name;
+    ascii_run_fn fn;
+    int (*usable) (void);       /* can it run on this CPU? */
+} Ascii_Run_Kernel;
+
+/* all implementations, terminated by an entry with a NULL name */
+extern const Ascii_Run_Kernel ascii_run_kernels[];
+
+/* Returns a newly allocated, NUL terminated, UTF-8 copy of the len bytes
+   of UTF-16LE in buf, its length (without the NUL added) going to
+   *utf8_len unless that is NULL.  The copy is only that long, len is not
+   its length.  Surrogate pairs become 4 byte sequences, unpaired
+   surrogates are kept as 3 byte sequences rather than dropped. */
+extern unsigned char* unicode_to_utf8 (size_t len, unsigned char *buf,
+                                       size_t *utf8_len);
+
+#endif /* UNICODE_H */
@@ -28,6 +28,32 @@
 #include "util.h"
 #include "options.h"
 
+static THREAD_LOCAL jmp_buf *exit_point = NULL;
+
+void
+set_exit_point (jmp_buf *point)
+{
+    exit_point = point;
+}
+
+void
+tnef_exit (int status)
+{
+    if (exit_point)
+    {
+        fflush (stdout);
+        longjmp (*exit_point, (status != 0) ? status : 1);
+    }
+    exit (status);
+}
+
+void
+input_corrupted (const char *where)
+{
+    fprintf (stderr, "%s: input file may be corrupted\n", where);
+    tnef_exit (1);
+}
+
 /* Needed to transform char buffers into little endian numbers */
 uint32 GETINT32(unsigned char *p)
 {
@@ -46,66 +72,40 @@ uint8 GETINT8 (unsigned char *p)
 }
 
 unsigned char*
-getbuf (FILE *fp, unsigned char buf[], size_t n)
+getbuf (Input *in, unsigned char buf[], size_t n)
 {
-    if (fread (buf, 1, n, fp) != n)
+    if (in->map)
+    {
+        memmove (buf, input_view (in, n), n);
+    }
+    else if (fread (buf, 1, n, in->fp) != n)
     {
         perror ("Unexpected end of input");
-        exit (1);
+        tnef_exit (1);
     }
     return buf;
 }
 
+/* header fields are decoded in place when the input is mapped */
 uint32
-geti32 (FILE *fp)
+geti32 (Input *in)
 {
     unsigned char buf[4];
-    return (uint32)GETINT32(getbuf(fp, buf, 4));
+    if (in->map) return (uint32)GETINT32(input_view(in, 4));
+    return (uint32)GETINT32(getbuf(in, buf, 4));
 }
 uint16
-geti16 (FILE *fp)
+geti16 (Input *in)
 {
     unsigned char buf[2];
-    return (uint16)GETINT16(getbuf(fp, buf, 2));
+    if (in->map) return (uint16)GETINT16(input_view(in, 2));
+    return (uint16)GETINT16(getbuf(in, buf, 2));
 }
 
 uint8
-geti8(FILE *fp)
+geti8(Input *in)
 {
     unsigned char buf[1];
-    return (uint8)GETINT8(getbuf(fp, buf, 1));
-}
-
-unsigned char*
-unicode_to_utf8 (size_t len, unsigned char* buf)
-{
-    int i = 0;
-    int j = 0;
-    unsigned char *utf8 = malloc (3 * len/2 + 1); /* won't get any longer than this */
-
-    if (len > 0) {
-        for (i = 0; i < len - 1; i += 2)
-        {
-            uint32 c = GETINT16(buf + i);
-            if (c <= 0x007f)
-            {
-                utf8[j++] = 0x00 | ((c & 0x007f) >> 0);
-            }
-            else if (c < 0x07ff)
-            {
-                utf8[j++] = 0xc0 | ((c & 0x07c0) >> 6);
-                utf8[j++] = 0x80 | ((c & 0x003f) >> 0);
-            }
-            else
-            {
-                utf8[j++] = 0xe0 | ((c & 0xf000) >> 12);
-                utf8[j++] = 0x80 | ((c & 0x0fc0) >> 6);
-                utf8[j++] = 0x80 | ((c & 0x003f) >> 0);
-            }
-        }
-    }
-
-    utf8[j] = '\0';
-
-    return utf8;
+    if (in->map) return (uint8)GETINT8(input_view(in, 1));
+    return (uint8)GETINT8(getbuf(in, buf, 1));
 }
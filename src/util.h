@@ -27,20 +27,33 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "common.h"
+#include "input.h"
 
-#define CHECKINT32(a, b) { if(a+4 > b){ exit(-1); } }
-#define CHECKINT16(a, b) { if(a+2 > b){ exit(-1); } }
-#define CHECKINT8(a, b) { if(a+1 > b){ exit(-1); } }
+#include <setjmp.h>
+
+#define CHECKINT32(a, b) { if(a+4 > b){ tnef_exit(-1); } }
+#define CHECKINT16(a, b) { if(a+2 > b){ tnef_exit(-1); } }
+#define CHECKINT8(a, b) { if(a+1 > b){ tnef_exit(-1); } }
+
+/* For what the input ought to be but cannot be relied on to be: gives
+   up on the parse, where an assert would abort a libtnef caller. */
+#define CHECKINPUT(c) { if (!(c)) { input_corrupted (__func__); } }
+
+/* Parsing gives up through tnef_exit rather than exit, so that batch
+   mode can carry on with the next file: when this thread has set an
+   exit point, it longjmps there with status instead of exiting. */
+extern void tnef_exit (int status);
+extern void set_exit_point (jmp_buf *point);
+extern void input_corrupted (const char *where);
 
 extern uint32 GETINT32(unsigned char*p);
 extern uint16 GETINT16(unsigned char*p);
 extern uint8 GETINT8(unsigned char*p);
 
-extern unsigned char* getbuf (FILE *fp, unsigned char buf[], size_t n);
-extern uint32 geti32(FILE *fp);
-extern uint16 geti16(FILE *fp);
-extern uint8 geti8(FILE *fp);
+extern unsigned char* getbuf (Input *in, unsigned char buf[], size_t n);
+extern uint32 geti32(Input *in);
+extern uint16 geti16(Input *in);
+extern uint8 geti8(Input *in);
 
-extern unsigned char* unicode_to_utf8 (size_t len, unsigned char*buf);
 
 #endif /* UTIL_H */
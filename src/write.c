@@ -5,132 +5,313 @@
 #include "common.h"
 #include "attr.h"
 #include "mapi_attr.h"
+#include "write.h"
 
-/* Format Strings */
-#define UINT8_FMT "%u"
-#define INT8_FMT "%d"
-#define UINT16_FMT "%hu"
-#define INT16_FMT "%hd"
-#if (SIZEOF_INT == 2)
-#define UINT32_FMT  "%lu"
-#define INT32_FMT  "%ld"
-#else
-#define UINT32_FMT  "%u"
-#define INT32_FMT  "%d"
-#endif /* (SIZEOF_INT == 2) */
+static const char hex_digits[] = "0123456789abcdef";
 
+/* room for the longest thing put in the buffer in one go */
+#define WRITER_SLOP 32
+
+void
+writer_open (Writer *w, FILE *fp, size_t limit)
+{
+    w->fp = fp;
+    w->limit = limit;
+    w->len = 0;
+}
+
+/* hands what has been formatted to fp */
+void
+writer_drain (Writer *w)
+{
+    if (w->len) fwrite (w->buf, 1, w->len, w->fp);
+    w->len = 0;
+}
+
+/* the one flush of a dump, so that what comes after on other streams
+   still reads in order */
+void
+writer_close (Writer *w)
+{
+    writer_drain (w);
+    fflush (w->fp);
+}
+
+static char *
+writer_reserve (Writer *w, size_t n)
+{
+    if (w->len + n > sizeof (w->buf)) writer_drain (w);
+    return w->buf + w->len;
+}
+
+void
+write_char (Writer *w, char c)
+{
+    *writer_reserve (w, 1) = c;
+    w->len++;
+}
+
+void
+write_chars (Writer *w, const char *s, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n = sizeof (w->buf) - w->len;
+        if (n == 0)
+        {
+            writer_drain (w);
+            n = sizeof (w->buf);
+        }
+        if (n > len) n = len;
+        memmove (w->buf + w->len, s, n);
+        w->len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+void
+write_text (Writer *w, const char *s)
+{
+    write_chars (w, s, strlen (s));
+}
+
+void
+write_unsigned (Writer *w, unsigned long v)
+{
+    char tmp[WRITER_SLOP];
+    char *p = tmp + sizeof (tmp);
+
+    do
+    {
+        *--p = '0' + (v % 10);
+        v /= 10;
+    }
+    while (v);
+    write_chars (w, p, tmp + sizeof (tmp) - p);
+}
+
+static void
+write_signed (Writer *w, long v)
+{
+    if (v < 0)
+    {
+        write_char (w, '-');
+        write_unsigned (w, -(unsigned long)v);
+    }
+    else
+    {
+        write_unsigned (w, (unsigned long)v);
+    }
+}
+
+/* v in lower case hex, at least digits wide, like "%0*x" */
 void
-write_uint8 (FILE* fp, uint8 b)
+write_hex (Writer *w, uint32 v, int digits)
+{
+    char tmp[WRITER_SLOP];
+    char *p = tmp + sizeof (tmp);
+
+    do
+    {
+        *--p = hex_digits[v & 0xf];
+        v >>= 4;
+        digits--;
+    }
+    while (v || digits > 0);
+    write_chars (w, p, tmp + sizeof (tmp) - p);
+}
+
+/* how many of len bytes of a value to show */
+size_t
+write_shown (Writer *w, size_t len)
 {
-    fprintf (fp, UINT8_FMT, b);
+    return (w->limit && len > w->limit) ? w->limit : len;
 }
 
-void 
-write_uint16 (FILE* fp, uint16 s)
+/* notes the len bytes of a value that were not shown */
+void
+write_more (Writer *w, size_t len)
 {
-    fprintf (fp, UINT16_FMT, s);
+    if (len == 0) return;
+    write_text (w, "[... ");
+    write_unsigned (w, (unsigned long)len);
+    write_text (w, " more bytes]");
 }
 
+/* each byte as 0x%02x with lead before it and trail after it (when
+   not '\0'), up to the limit of the writer */
 void
-write_uint32 (FILE* fp, uint32 l)
+write_bytes (Writer *w, const unsigned char *buf, size_t len,
+             char lead, char trail)
 {
-    fprintf (fp, UINT32_FMT, l);
+    size_t shown = write_shown (w, len);
+    size_t i;
+
+    for (i = 0; i < shown; i++)
+    {
+        char *p = writer_reserve (w, 6);
+        char *q = p;
+        if (lead) *q++ = lead;
+        *q++ = '0';
+        *q++ = 'x';
+        *q++ = hex_digits[buf[i] >> 4];
+        *q++ = hex_digits[buf[i] & 0xf];
+        if (trail) *q++ = trail;
+        w->len += q - p;
+    }
+    if (shown < len)
+    {
+        if (lead) write_char (w, lead);
+        write_more (w, len - shown);
+    }
 }
 
 void
-write_int8 (FILE* fp, int8 b)
+write_uint8 (Writer *w, uint8 b)
 {
-    fprintf (fp, INT8_FMT, b);
+    write_unsigned (w, b);
 }
 
 void
-write_int16 (FILE* fp, int16 s)
+write_uint16 (Writer *w, uint16 s)
 {
-    fprintf (fp, INT16_FMT, s);
+    write_unsigned (w, s);
 }
 
 void
-write_int32 (FILE* fp, int32 l)
+write_uint32 (Writer *w, uint32 l)
 {
-    fprintf (fp, INT32_FMT, l);
+    write_unsigned (w, l);
 }
 
 void
-write_float (FILE *fp, float f)
+write_int8 (Writer *w, int8 b)
 {
-    fprintf (fp, "%f", f);
+    write_signed (w, b);
 }
 
 void
-write_string (FILE *fp, const char *s)
+write_int16 (Writer *w, int16 s)
 {
-    fprintf (fp, "'%s'", s);
+    write_signed (w, s);
 }
 
-void 
-write_byte (FILE* fp, uint8 b)
+void
+write_int32 (Writer *w, int32 l)
 {
-    fprintf (fp, "0x%02x", b);
+    write_signed (w, l);
 }
 
 void
-write_word (FILE *fp, uint16 w)
+write_float (Writer *w, float f)
 {
-    fprintf (fp, "0x%04x", w);
+    char tmp[64];               /* %f of FLT_MAX is 46 chars */
+    int n = snprintf (tmp, sizeof (tmp), "%f", f);
+    if (n > 0) write_chars (w, tmp, ((size_t)n < sizeof (tmp)
+                                     ? (size_t)n : sizeof (tmp) - 1));
 }
 
 void
-write_dword (FILE *fp, uint32 dw)
+write_string (Writer *w, const char *s)
 {
-    fprintf (fp, "0x%08x", dw);
+    write_char (w, '\'');
+    write_text (w, (s ? s : "(null)"));
+    write_char (w, '\'');
 }
 
 void
-write_date (FILE *fp, struct date* dt)
+write_byte (Writer *w, uint8 b)
 {
-    fprintf (fp, "%s", date_to_str (dt));
+    write_text (w, "0x");
+    write_hex (w, b, 2);
 }
 
 void
-write_triple (FILE* fp, TRIPLE* triple)
+write_word (Writer *w, uint16 wd)
 {
-    fprintf (fp,
-	     "{id=" UINT16_FMT 
-	     ",chgtrp=" UINT16_FMT 
-	     ",cch=" UINT16_FMT 
-	     ",cb=" UINT16_FMT "} "
-	     "sender_display_name='%s', "
-	     "sender_address='%s'",
-	     triple->trp.id,
-	     triple->trp.chbgtrp,
-	     triple->trp.cch,
-	     triple->trp.cb,
-	     triple->sender_display_name,
-	     triple->sender_address);
+    write_text (w, "0x");
+    write_hex (w, wd, 4);
 }
 
 void
-write_boolean (FILE *fp, uint16 b)
+write_dword (Writer *w, uint32 dw)
 {
-    fprintf (fp, "%s", ((b == 0) ? "false" : "true"));
+    write_text (w, "0x");
+    write_hex (w, dw, 8);
 }
 
 void
-write_uint64 (FILE *fp, uint32 bytes[2])
+write_date (Writer *w, struct date* dt)
 {
-    fprintf (fp, "0x%08x 0x%08x", bytes[0], bytes[1]);
+    char buf[DATE_STR_SIZE];
+    write_text (w, date_to_str (dt, buf));
 }
 
-void 
-write_guid (FILE *fp, GUID *guid)
+void
+write_triple (Writer *w, TRIPLE* triple)
+{
+    write_text (w, "{id=");
+    write_uint16 (w, triple->trp.id);
+    write_text (w, ",chgtrp=");
+    write_uint16 (w, triple->trp.chbgtrp);
+    write_text (w, ",cch=");
+    write_uint16 (w, triple->trp.cch);
+    write_text (w, ",cb=");
+    write_uint16 (w, triple->trp.cb);
+    write_text (w, "} sender_display_name=");
+    write_string (w, triple->sender_display_name);
+    write_text (w, ", sender_address=");
+    write_string (w, triple->sender_address);
+}
+
+void
+write_boolean (Writer *w, uint16 b)
+{
+    write_text (w, ((b == 0) ? "false" : "true"));
+}
+
+void
+write_uint64 (Writer *w, uint32 bytes[2])
+{
+    write_dword (w, bytes[0]);
+    write_char (w, ' ');
+    write_dword (w, bytes[1]);
+}
+
+void
+write_guid (Writer *w, GUID *guid)
 {
     int j;
-    fprintf (fp, "{ 0x%04x 0x%02x 0x%02x { ",
-	     guid->data1, guid->data2, guid->data3);
+    write_text (w, "{ 0x");
+    write_hex (w, guid->data1, 4);
+    write_text (w, " 0x");
+    write_hex (w, guid->data2, 2);
+    write_text (w, " 0x");
+    write_hex (w, guid->data3, 2);
+    write_text (w, " { ");
     for (j = 0; j < 8; j++)
     {
-	write_byte (fp, guid->data4[j]);
-	fprintf (fp, " ");
+        write_byte (w, guid->data4[j]);
+        write_char (w, ' ');
+    }
+    write_char (w, '}');
+}
+
+/* writes the name of value as looked up in one of the generated tables,
+   followed by the value itself, or just the value if it has no name */
+void
+write_name (Writer *w, const char *name, uint16 value)
+{
+    if (name)
+    {
+        write_text (w, name);
+        write_text (w, " <");
+        write_hex (w, value, 4);
+        write_char (w, '>');
+    }
+    else
+    {
+        write_hex (w, value, 4);
     }
-    fprintf (fp, "}");
 }
@@ -5,21 +5,49 @@
 #include "attr.h"
 #include "mapi_attr.h"
 
-extern void write_uint8 (FILE* fp, uint8 b);
-extern void write_uint16 (FILE* fp, uint16 s);
-extern void write_uint32 (FILE* fp, uint32 l);
-extern void write_int8 (FILE* fp, int8 b);
-extern void write_int16 (FILE* fp, int16 s);
-extern void write_int32 (FILE* fp, int32 l);
-extern void write_float (FILE *fp, float f);
-extern void write_string(FILE* fp, const char *s);
-extern void write_byte (FILE* fp, uint8 b);
-extern void write_word (FILE *fp, uint16 w);
-extern void write_dword (FILE *fp, uint32 dw);
-extern void write_date (FILE *fp, struct date* dt);
-extern void write_triple (FILE* fp, TRIPLE *triple);
-extern void write_boolean (FILE *fp, uint16 b);
-extern void write_uint64 (FILE *fp, uint32 bytes[2]);
-extern void write_guid (FILE *fp, GUID *guid);
+#define WRITER_BUFFER_SIZE 8192
+
+/* Formats into buf and only hands it to fp when full or closed, so
+   a dump costs a handful of fwrites however large the values are.
+   Lives on the stack, nothing is allocated. */
+typedef struct
+{
+    FILE *fp;
+    size_t limit;               /* bytes shown of a value, 0 for all */
+    size_t len;
+    char buf[WRITER_BUFFER_SIZE];
+} Writer;
+
+extern void writer_open (Writer *w, FILE *fp, size_t limit);
+extern void writer_drain (Writer *w);
+extern void writer_close (Writer *w);
+
+extern void write_char (Writer *w, char c);
+extern void write_text (Writer *w, const char *s);
+extern void write_chars (Writer *w, const char *s, size_t len);
+extern void write_unsigned (Writer *w, unsigned long v);
+extern void write_hex (Writer *w, uint32 v, int digits);
+extern size_t write_shown (Writer *w, size_t len);
+extern void write_more (Writer *w, size_t len);
+extern void write_bytes (Writer *w, const unsigned char *buf, size_t len,
+                         char lead, char trail);
+
+extern void write_uint8 (Writer *w, uint8 b);
+extern void write_uint16 (Writer *w, uint16 s);
+extern void write_uint32 (Writer *w, uint32 l);
+extern void write_int8 (Writer *w, int8 b);
+extern void write_int16 (Writer *w, int16 s);
+extern void write_int32 (Writer *w, int32 l);
+extern void write_float (Writer *w, float f);
+extern void write_string(Writer *w, const char *s);
+extern void write_byte (Writer *w, uint8 b);
+extern void write_word (Writer *w, uint16 wd);
+extern void write_dword (Writer *w, uint32 dw);
+extern void write_date (Writer *w, struct date* dt);
+extern void write_triple (Writer *w, TRIPLE *triple);
+extern void write_boolean (Writer *w, uint16 b);
+extern void write_uint64 (Writer *w, uint32 bytes[2]);
+extern void write_guid (Writer *w, GUID *guid);
+extern void write_name (Writer *w, const char *name, uint16 value);
 
 #endif /* WRITE_H */
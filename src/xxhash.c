@@ -0,0 +1,192 @@
+/*
+ * xxhash.c -- the XXH64 hash
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       XXH64 as specified by Yann Collet's xxHash, written out here
+ *       rather than adding a dependency.  It runs at several GB/s,
+ *       which keeps hashing attachments for the --store well below the
+ *       cost of writing them.  It is not a cryptographic hash.
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#include "xxhash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* little endian whatever the host */
+static uint64_t
+read64 (const unsigned char *p)
+{
+    return ((uint64_t)p[0]       | ((uint64_t)p[1] << 8)
+            | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+            | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40)
+            | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56));
+}
+
+static uint64_t
+read32 (const unsigned char *p)
+{
+    return ((uint64_t)p[0]       | ((uint64_t)p[1] << 8)
+            | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24));
+}
+
+static uint64_t
+xxh64_round (uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = ROTL64 (acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t
+xxh64_merge (uint64_t acc, uint64_t v)
+{
+    acc ^= xxh64_round (0, v);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/* consumes the 32 byte stripes at p, returning how much was used */
+static size_t
+xxh64_stripes (uint64_t v[4], const unsigned char *p, size_t len)
+{
+    size_t done = 0;
+
+    while (len - done >= 32)
+    {
+        v[0] = xxh64_round (v[0], read64 (p + done));
+        v[1] = xxh64_round (v[1], read64 (p + done + 8));
+        v[2] = xxh64_round (v[2], read64 (p + done + 16));
+        v[3] = xxh64_round (v[3], read64 (p + done + 24));
+        done += 32;
+    }
+    return done;
+}
+
+void
+xxh64_init (XXH64_State *state, uint64_t seed)
+{
+    memset (state, '\0', sizeof (XXH64_State));
+    state->seed = seed;
+    state->v[0] = seed + PRIME64_1 + PRIME64_2;
+    state->v[1] = seed + PRIME64_2;
+    state->v[2] = seed;
+    state->v[3] = seed - PRIME64_1;
+}
+
+void
+xxh64_update (XXH64_State *state, const void *buf, size_t len)
+{
+    const unsigned char *p = (const unsigned char*)buf;
+
+    state->total_len += len;
+
+    if (state->mem_len + len < 32)
+    {
+        memmove (state->mem + state->mem_len, p, len);
+        state->mem_len += len;
+        return;
+    }
+    if (state->mem_len)
+    {
+        size_t fill = 32 - state->mem_len;
+        memmove (state->mem + state->mem_len, p, fill);
+        xxh64_stripes (state->v, state->mem, 32);
+        p += fill;
+        len -= fill;
+        state->mem_len = 0;
+    }
+    p += xxh64_stripes (state->v, p, len);
+    len = (len % 32);
+    memmove (state->mem, p, len);
+    state->mem_len = len;
+}
+
+uint64_t
+xxh64_digest (const XXH64_State *state)
+{
+    const unsigned char *p = state->mem;
+    size_t len = state->mem_len;
+    uint64_t h;
+
+    if (state->total_len >= 32)
+    {
+        const uint64_t *v = state->v;
+        h = (ROTL64 (v[0], 1) + ROTL64 (v[1], 7)
+             + ROTL64 (v[2], 12) + ROTL64 (v[3], 18));
+        h = xxh64_merge (h, v[0]);
+        h = xxh64_merge (h, v[1]);
+        h = xxh64_merge (h, v[2]);
+        h = xxh64_merge (h, v[3]);
+    }
+    else
+    {
+        h = state->seed + PRIME64_5;
+    }
+    h += state->total_len;
+
+    while (len >= 8)
+    {
+        h ^= xxh64_round (0, read64 (p));
+        h = ROTL64 (h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4)
+    {
+        h ^= read32 (p) * PRIME64_1;
+        h = ROTL64 (h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0)
+    {
+        h ^= (*p) * PRIME64_5;
+        h = ROTL64 (h, 11) * PRIME64_1;
+        p++;
+        len--;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t
+xxh64 (const void *buf, size_t len, uint64_t seed)
+{
+    XXH64_State state;
+
+    xxh64_init (&state, seed);
+    xxh64_update (&state, buf, len);
+    return xxh64_digest (&state);
+}
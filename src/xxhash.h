@@ -0,0 +1,51 @@
+/*
+ * xxhash.h -- the XXH64 hash
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef XXHASH_H
+#define XXHASH_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+
+#if HAVE_STDINT_H
+#  include <stdint.h>
+#endif
+
+/* For hashing data that comes a piece at a time */
+typedef struct
+{
+    uint64_t total_len;
+    uint64_t v[4];
+    unsigned char mem[32];      /* what is left of a stripe */
+    size_t mem_len;
+    uint64_t seed;
+} XXH64_State;
+
+extern void xxh64_init (XXH64_State *state, uint64_t seed);
+extern void xxh64_update (XXH64_State *state, const void *buf, size_t len);
+extern uint64_t xxh64_digest (const XXH64_State *state);
+
+extern uint64_t xxh64 (const void *buf, size_t len, uint64_t seed);
+
+#endif /* XXHASH_H */
@@ -0,0 +1,182 @@
+/*
+ * buffer.c -- list a TNEF file through libtnef's tnef_parse_buffer
+ *
+ * Copyright (C)1999-2018 Mark Simpson <damned@theworld.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can either send email to this
+ * program's maintainer or write to: The Free Software Foundation,
+ * Inc.; 59 Temple Place, Suite 330; Boston, MA 02111-1307, USA.
+ *
+ * Commentary:
+ *       usage: buffer [-s|-e] FILE
+ *       Prints what is reported for each attachment and body, with a
+ *       hash of its data, and the result.  -s stops at the first
+ *       attachment, -e shows every event, with the length and hash of
+ *       property values and names.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libtnef.h"
+
+static int stop_early = 0;
+static int show_events = 0;
+static size_t chunked = 0;          /* data seen of the attachment */
+
+/* FNV-1a, enough to tell whether the data came through intact */
+static unsigned long
+hash (const TNEF_Span *span)
+{
+    unsigned long h = 2166136261UL;
+    size_t i;
+
+    for (i = 0; i < span->len; i++)
+    {
+        h = ((h ^ span->data[i]) * 16777619UL) & 0xffffffffUL;
+    }
+    return h;
+}
+
+static int
+on_attribute (void *user_data, const TNEF_Attribute *attr)
+{
+    (void)user_data;
+    if (show_events)
+        printf ("  attribute: %d %04x %04x | %lu\n",
+                (int)attr->level, attr->name, attr->type,
+                (unsigned long)attr->data.len);
+    return 0;
+}
+
+/* the length and hash of each of n spans */
+static void
+print_spans (const char *what, size_t n, const TNEF_Span *spans)
+{
+    size_t i;
+
+    printf ("    %s:", what);
+    for (i = 0; i < n; i++)
+    {
+        printf (" %lu/%08lx", (unsigned long)spans[i].len, hash (&spans[i]));
+    }
+    printf ("\n");
+}
+
+static int
+on_mapi_property (void *user_data, const TNEF_Property *prop)
+{
+    (void)user_data;
+    if (show_events)
+    {
+        printf ("  property: %d %04x %04x | %lu values, %lu names\n",
+                (int)prop->level, prop->name, prop->type,
+                (unsigned long)prop->num_values,
+                (unsigned long)prop->num_names);
+        print_spans ("values", prop->num_values, prop->values);
+        if (prop->num_names)
+            print_spans ("names", prop->num_names, prop->names);
+    }
+    return 0;
+}
+
+static int
+on_attachment_begin (void *user_data)
+{
+    (void)user_data;
+    if (show_events) printf ("  begin\n");
+    chunked = 0;
+    return 0;
+}
+
+static int
+on_attachment_data_chunk (void *user_data, const TNEF_Span *chunk)
+{
+    (void)user_data;
+    if (show_events) printf ("  chunk: %lu\n", (unsigned long)chunk->len);
+    chunked += chunk->len;
+    return 0;
+}
+
+static int
+on_attachment_end (void *user_data, const TNEF_Attachment *att)
+{
+    (void)user_data;
+    if (chunked != att->data.len) printf ("chunks do not add up\n");
+    printf ("attachment: %s | %s | %s | %04u/%02u/%02u %02u:%02u:%02u"
+            " | %lu | %08lx\n",
+            att->name ? att->name : "(none)",
+            att->mime_type ? att->mime_type : "(none)",
+            att->content_id ? att->content_id : "(none)",
+            att->date.year, att->date.month, att->date.day,
+            att->date.hour, att->date.min, att->date.sec,
+            (unsigned long)att->data.len, hash (&att->data));
+    return stop_early;
+}
+
+static int
+on_body (void *user_data, TNEF_Body_Type type, const TNEF_Span *body)
+{
+    (void)user_data;
+    printf ("body %c: %lu | %08lx\n",
+            (char)type, (unsigned long)body->len, hash (body));
+    return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    TNEF_Callbacks callbacks;
+    unsigned char *buf;
+    long len;
+    FILE *fp;
+
+    if (argc > 1 && strcmp (argv[1], "-s") == 0)
+    {
+        stop_early = 1;
+        argc--; argv++;
+    }
+    else if (argc > 1 && strcmp (argv[1], "-e") == 0)
+    {
+        show_events = 1;
+        argc--; argv++;
+    }
+    if (argc != 2 || (fp = fopen (argv[1], "rb")) == NULL)
+    {
+        fprintf (stderr, "usage: buffer [-s|-e] FILE\n");
+        return 2;
+    }
+    if (fseek (fp, 0, SEEK_END) != 0 || (len = ftell (fp)) < 0
+        || fseek (fp, 0, SEEK_SET) != 0
+        || (buf = malloc ((size_t)len + 1)) == NULL
+        || fread (buf, 1, (size_t)len, fp) != (size_t)len)
+    {
+        perror (argv[1]);
+        return 2;
+    }
+    fclose (fp);
+
+    memset (&callbacks, '\0', sizeof (callbacks));
+    callbacks.on_attribute = on_attribute;
+    callbacks.on_mapi_property = on_mapi_property;
+    callbacks.on_attachment_begin = on_attachment_begin;
+    callbacks.on_attachment_data_chunk = on_attachment_data_chunk;
+    callbacks.on_attachment_end = on_attachment_end;
+    callbacks.on_body = on_body;
+
+    printf ("result: %d\n", tnef_parse_buffer (buf, (size_t)len, &callbacks));
+    tnef_thread_release ();
+    free (buf);
+    return 0;
+}